@@ -1,2 +1,8 @@
 set -e
-make -C src build ARCH=js -j `node -e "process.stdout.write(String(require('os').cpus().length))"` && cat src/pre.js src/stockfish.js src/post.js > src/stockfish-make-tmp.js && mv src/stockfish-make-tmp.js src/stockfish.js
+CORES=`node -e "process.stdout.write(String(require('os').cpus().length))"`
+if [ "$1" = "threads" ]; then
+    ## The pthreads build loads its workers from stockfish-threads.worker.js, so it is not wrapped.
+    make -C src build ARCH=js-threads -j $CORES
+else
+    make -C src build ARCH=js -j $CORES && cat src/pre.js src/stockfish.js src/post.js > src/stockfish-make-tmp.js && mv src/stockfish-make-tmp.js src/stockfish.js
+fi
@@ -17,12 +17,19 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <istream>
+#include <map>
+#include <sstream>
 #include <vector>
 
+#include "engine.h"
+#include "evaluate.h"
 #include "misc.h"
+#include "numa.h"
 #include "position.h"
 #include "search.h"
 #include "thread.h"
@@ -79,12 +86,36 @@ const char* Defaults[] = {
   "8/R7/2q5/8/6k1/8/1P5p/K6R w - - 0 124", // Draw
 };
 
+
+// probe_latency() returns the average time in nanoseconds of a TT probe of a
+// random key, made from a CPU of the given NUMA node.
+
+double probe_latency(int node) {
+
+  const int Probes = 1 << 22;
+  PRNG rng(1070372);
+  bool found;
+
+  NUMA::bind_this_thread(node);
+  Time::point elapsed = Time::now();
+
+  for (int i = 0; i < Probes; ++i)
+      UCIEngine.tt->probe(rng.rand<Key>(), found);
+
+  elapsed = Time::now() - elapsed;
+  NUMA::bind_this_thread(-1);
+
+  return elapsed * 1e6 / Probes;
+}
+
 } // namespace
 
 /// benchmark() runs a simple benchmark by letting Stockfish analyze a set
 /// of positions for a given limit each. There are five parameters: the
 /// transposition table size, the number of search threads that should
-/// be used, the limit value spent for each position (optional, default is
+/// be used (a comma separated list like 1,2,4 runs the suite once per
+/// count and reports the scaling), the limit value spent for each
+/// position (optional, default is
 /// depth 13), an optional file name where to look for positions in FEN
 /// format (defaults are the positions defined above) and the type of the
 /// limit value: depth (default), time in millisecs or number of nodes.
@@ -102,9 +133,8 @@ void benchmark(const Position& current, istream& is) {
   string fenFile   = (is >> token) ? token : "default";
   string limitType = (is >> token) ? token : "depth";
 
+  UCIEngine.threads.wait_for_think_finished(); // Don't resize the TT under a running search
   Options["Hash"]    = ttSize;
-  Options["Threads"] = threads;
-  TT.clear();
 
   if (limitType == "time")
       limits.movetime = atoi(limit.c_str()); // movetime is in ms
@@ -142,33 +172,477 @@ void benchmark(const Position& current, istream& is) {
       file.close();
   }
 
-  uint64_t nodes = 0;
+  // A comma separated list of thread counts, e.g. "1,2,4,8", runs the whole
+  // suite once per count and ends with a scaling report.
+  vector<size_t> threadCounts;
+  vector<uint64_t> nodesByRun;
+  vector<Time::point> timeByRun;
+  stringstream ts(threads);
+
+  while (getline(ts, token, ','))
+      if (atoi(token.c_str()) > 0)
+          threadCounts.push_back(atoi(token.c_str()));
+
+  for (size_t run = 0; run < threadCounts.size(); ++run)
+  {
+      ostringstream tc;
+      tc << threadCounts[run];
+      Options["Threads"] = tc.str();
+      UCIEngine.tt->clear();
+
+      uint64_t nodes = 0;
+      vector<uint64_t> threadNodes(UCIEngine.threads.size());
+      Search::StateStackPtr st;
+      Time::point elapsed = Time::now();
+
+      for (size_t i = 0; i < fens.size(); ++i)
+      {
+          Position pos(fens[i], Options["UCI_Chess960"], UCIEngine.threads.main());
+
+          cerr << "\nPosition: " << i + 1 << '/' << fens.size() << endl;
+
+          if (limitType == "perft")
+              nodes += Search::perft(pos, limits.depth * ONE_PLY);
+
+          else
+          {
+              UCIEngine.threads.start_thinking(pos, limits, st);
+              UCIEngine.threads.wait_for_think_finished();
+              nodes += UCIEngine.threads.nodes_searched();
+
+              for (size_t j = 0; j < UCIEngine.threads.size(); ++j)
+                  threadNodes[j] += UCIEngine.threads[j]->nodes_searched();
+          }
+      }
+
+      elapsed = Time::now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+      dbg_print(); // Just before to exit
+
+      cerr << "\n==========================="
+           << "\nThreads         : " << threadCounts[run]
+           << "\nTotal time (ms) : " << elapsed
+           << "\nNodes searched  : " << nodes
+           << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+
+      // Load and TT probe latency of each node, to check the NUMA placement
+      if (Options["NUMA Binding"])
+          for (int n = 0; n < NUMA::nodes(); ++n)
+          {
+              size_t cnt = 0;
+              uint64_t nodeNodes = 0;
+
+              for (size_t j = 0; j < UCIEngine.threads.size(); ++j)
+                  if (UCIEngine.threads[j]->numaNode == n)
+                      ++cnt, nodeNodes += threadNodes[j];
+
+              cerr << "NUMA node " << setw(2) << left << n << right << "    : "
+                   << cnt << " threads, " << 1000 * nodeNodes / elapsed
+                   << " nodes/second, " << fixed << setprecision(1)
+                   << probe_latency(n) << " ns/probe" << endl;
+          }
+
+      nodesByRun.push_back(nodes);
+      timeByRun.push_back(elapsed);
+  }
+
+  if (threadCounts.size() < 2)
+      return;
+
+  // Speedups are relative to the first run. With a depth limit the time ratio
+  // is the time-to-depth speedup, the nodes/second ratio is raw SMP throughput.
+  double baseNps = 1000.0 * nodesByRun[0] / timeByRun[0];
+
+  cerr << "\n==========================="
+       << "\nThreads   Time (ms)        Nodes   Nodes/second  NPS speedup  TTD speedup" << endl;
+
+  for (size_t run = 0; run < threadCounts.size(); ++run)
+  {
+      double nps = 1000.0 * nodesByRun[run] / timeByRun[run];
+
+      cerr << setw(7)  << threadCounts[run]
+           << setw(12) << timeByRun[run]
+           << setw(13) << nodesByRun[run]
+           << setw(15) << uint64_t(nps)
+           << setw(13) << fixed << setprecision(2) << nps / baseNps
+           << setw(13) << double(timeByRun[0]) / timeByRun[run] << endl;
+  }
+}
+
+
+namespace {
+
+// BatchJob is shared by the batch workers. Positions are read and results
+// written under the mutex, a chunk of lines at a time, results waiting in
+// 'done' until all the chunks before them are written, so that the output
+// follows the input order. A search takes long enough to read one position
+// per chunk, a static eval or a qsearch does not.
+
+enum BatchMode { BATCH_SEARCH, BATCH_EVAL, BATCH_QSEARCH };
+
+const size_t BatchChunk = 256;
+
+struct BatchJob {
+  istream* in;
+  BatchMode mode;
+  Search::LimitsType limits;
+  size_t read, written, positions;
+  bool eof;
+  map<size_t, string> done;
+  uint64_t nodes;
+  Mutex mutex;
+};
+
+struct BatchWorker {
+  BatchJob* job;
+  Engine* engine;
+  NativeHandle handle;
+};
+
+// The engines of the workers are kept between two batches, starting their
+// threads and allocating their pawn tables is slower than a short batch. They
+// are replaced when the number of workers or the "Pawn Hash" size changes.
+
+vector<Engine*> BatchEngines;
+size_t BatchPawnHash;
+
+
+// batch_score() formats a score of the side to move as the "score" and "mate"
+// fields of a batch result, both from White's point of view: centipawns, or
+// the number of moves to mate, negative when Black mates. The other one is
+// null. A side to move already checkmated is mate 0.
+
+string batch_score(Value v, Color us) {
+
+  stringstream ss;
+
+  if (us == BLACK)
+      v = -v;
+
+  if (abs(v) < VALUE_MATE_IN_MAX_PLY)
+      ss << "\"score\":" << v * 100 / PawnValueEg << ",\"mate\":null";
+  else
+      ss << "\"score\":null,\"mate\":" << (v > 0 ? VALUE_MATE - v + 1 : -VALUE_MATE - v) / 2;
+
+  return ss.str();
+}
+
+
+// batch_result() formats the outcome of the last search of an engine as a
+// JSON object on a single line.
+
+string batch_result(const string& fen, Engine& e, Time::point elapsed) {
+
+  const Search::RootMove& rm = e.rootMoves[0];
+  Value v = rm.score != -VALUE_INFINITE ? rm.score : rm.previousScore;
+  Depth d = e.threads.main()->completedDepth;
+  stringstream ss;
+
+  if (rm.pv[0] == MOVE_NONE) // Mate or stalemate at the root
+      v = e.rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW, d = DEPTH_ZERO;
+
+  ss << "{\"fen\":\"" << fen
+     << "\"," << batch_score(v, e.rootPos.side_to_move())
+     << ",\"depth\":" << d / ONE_PLY
+     << ",\"pv\":\"";
+
+  for (size_t i = 0; i < rm.pv.size() && rm.pv[i] != MOVE_NONE; ++i)
+      ss << (i ? " " : "") << UCI::move(rm.pv[i], e.rootPos.is_chess960());
+
+  ss << "\",\"nodes\":" << e.threads.nodes_searched()
+     << ",\"time\":" << elapsed << "}";
+
+  return ss.str();
+}
+
+
+// batch_worker() is the C function launched for each batch worker. It takes
+// the next chunk of positions from the input, searches or evaluates them with
+// its own engine and hands the results over for output, until the input is
+// exhausted. In the eval and qsearch modes the same Position object is set to
+// each FEN in turn, and nothing goes through the threads of the engine.
+
+extern "C" { void* batch_worker(void* arg) {
+
+  BatchWorker* w = static_cast<BatchWorker*>(arg);
+  BatchJob& job = *w->job;
+  Engine& e = *w->engine;
   Search::StateStackPtr st;
-  Time::point elapsed = Time::now();
+  bool chess960 = Options["UCI_Chess960"];
+  size_t chunk = job.mode == BATCH_SEARCH ? 1 : BatchChunk;
+  vector<string> fens;
+  Position pos;
+  string fen;
 
-  for (size_t i = 0; i < fens.size(); ++i)
+  while (true)
+  {
+      job.mutex.lock();
+
+      fens.clear();
+      while (!job.eof && fens.size() < chunk)
+      {
+          if (!getline(*job.in, fen) || fen == "end")
+              job.eof = true;
+
+          else
+          {
+              if (!fen.empty() && fen[fen.size() - 1] == '\r')
+                  fen.erase(fen.size() - 1);
+
+              if (!fen.empty())
+                  fens.push_back(fen);
+          }
+      }
+
+      size_t idx = job.read++;
+      job.mutex.unlock();
+
+      if (fens.empty())
+          break;
+
+      uint64_t nodes = 0;
+      stringstream result;
+
+      for (size_t i = 0; i < fens.size(); ++i)
+      {
+          if (i)
+              result << "\n";
+
+          pos.set(fens[i], chess960, e.threads.main());
+
+          if (job.mode == BATCH_SEARCH)
+          {
+              e.threads.start_thinking(pos, job.limits, st);
+              e.threads.wait_for_think_finished();
+
+              Time::point elapsed = Time::now() - e.searchTime;
+              result << batch_result(fens[i], e, elapsed);
+              nodes += e.threads.nodes_searched();
+              continue;
+          }
+
+          result << "{\"fen\":\"" << fens[i] << "\",";
+
+          if (job.mode == BATCH_EVAL && pos.checkers()) // No static eval when in check
+          {
+              result << "\"score\":null,\"mate\":null}";
+              continue;
+          }
+
+          Value v = job.mode == BATCH_QSEARCH ? Search::quiescence(pos) : Eval::evaluate(pos);
+          nodes += pos.nodes_searched();
+
+          result << batch_score(v, pos.side_to_move()) << "}";
+      }
+
+      job.mutex.lock();
+
+      job.nodes += nodes;
+      job.positions += fens.size();
+      job.done[idx] = result.str();
+
+      for (map<size_t, string>::iterator it; (it = job.done.find(job.written)) != job.done.end(); ++job.written)
+      {
+          sync_cout << it->second << sync_endl;
+          job.done.erase(it);
+      }
+
+      job.mutex.unlock();
+  }
+
+  return NULL;
+} }
+
+} // namespace
+
+
+/// batch_exit() terminates the engines kept by batch() for the next batch
+
+void batch_exit() {
+
+  for (size_t i = 0; i < BatchEngines.size(); ++i)
+  {
+      BatchEngines[i]->exit();
+      delete BatchEngines[i];
+  }
+
+  BatchEngines.clear();
+}
+
+
+/// batch() searches a stream of positions, several of them at once, and prints
+/// one JSON object per position (FEN, score, mate, depth, PV, nodes, time) in the
+/// order of the input. Parameters are given as name/value pairs: 'workers' is
+/// the number of positions searched at once (defaults to the "Threads" option),
+/// each one by an engine with a single thread; 'depth', 'nodes' or 'movetime'
+/// sets the limit (default is depth 13); 'file' names a file with one FEN per
+/// line, otherwise FENs are read from standard input up to a line 'end'. The
+/// workers share the transposition table of the UCI engine. With the 'eval' or
+/// 'qsearch' flag, positions are not searched: only FEN and score are printed,
+/// the score being the static evaluation (null when in check) or the
+/// quiescence search score. In all modes the score is given from White's point
+/// of view, as centipawns in "score" or as moves to mate in "mate", see
+/// batch_score().
+
+void batch(istream& is) {
+
+#ifdef NO_THREADS
+  sync_cout << "info string batch is not available in single threaded Stockfish.js" << sync_endl;
+  return;
+#endif
+
+  BatchJob job;
+  string token, fenFile;
+  size_t workers = Options["Threads"];
+
+  job.mode = BATCH_SEARCH;
+  job.limits.depth = 13;
+
+  while (is >> token)
+      if (token == "workers")
+          is >> workers;
+      else if (token == "depth")
+          is >> job.limits.depth, job.limits.nodes = job.limits.movetime = 0;
+      else if (token == "nodes")
+          is >> job.limits.nodes, job.limits.depth = job.limits.movetime = 0;
+      else if (token == "movetime")
+          is >> job.limits.movetime, job.limits.depth = job.limits.nodes = 0;
+      else if (token == "file")
+          is >> fenFile;
+      else if (token == "eval")
+          job.mode = BATCH_EVAL;
+      else if (token == "qsearch")
+          job.mode = BATCH_QSEARCH;
+
+  ifstream file;
+
+  if (!fenFile.empty())
   {
-      Position pos(fens[i], Options["UCI_Chess960"], Threads.main());
+      file.open(fenFile.c_str());
+
+      if (!file.is_open())
+      {
+          cerr << "Unable to open file " << fenFile << endl;
+          return;
+      }
+  }
+
+  UCIEngine.threads.wait_for_think_finished(); // The TT is shared with the UCI engine
+  UCIEngine.tt->new_search(); // Once for the whole batch, workers don't age the TT
+
+  job.in = fenFile.empty() ? &cin : &file;
+  job.read = job.written = job.positions = 0;
+  job.eof = false;
+  job.nodes = 0;
 
-      cerr << "\nPosition: " << i + 1 << '/' << fens.size() << endl;
+  vector<BatchWorker> pool(std::max(workers, size_t(1)));
 
-      if (limitType == "perft")
-          nodes += Search::perft<true>(pos, limits.depth * ONE_PLY);
+  if (BatchEngines.size() != pool.size() || BatchPawnHash != size_t(Options["Pawn Hash"]))
+  {
+      batch_exit();
+
+      BatchPawnHash = Options["Pawn Hash"];
 
-      else
+      for (size_t i = 0; i < pool.size(); ++i)
       {
-          Threads.start_thinking(pos, limits, st);
-          Threads.wait_for_think_finished();
-          nodes += Search::RootPos.nodes_searched();
+          BatchEngines.push_back(new Engine(UCIEngine.tt, 1));
+          BatchEngines[i]->silent = true;
+          BatchEngines[i]->init();
       }
   }
 
-  elapsed = Time::now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+  for (size_t i = 0; i < pool.size(); ++i)
+  {
+      pool[i].job = &job;
+      pool[i].engine = BatchEngines[i];
+
+      // Set up by think() in search mode, used directly by qsearch otherwise.
+      // Cleared for each batch, so results do not depend on the previous one.
+      pool[i].engine->history.clear();
+      pool[i].engine->drawValue[WHITE] = pool[i].engine->drawValue[BLACK] = VALUE_DRAW;
+  }
+
+  Time::point elapsed = Time::now();
 
-  dbg_print(); // Just before to exit
+  for (size_t i = 0; i < pool.size(); ++i)
+      thread_create(pool[i].handle, batch_worker, &pool[i]);
+
+  for (size_t i = 0; i < pool.size(); ++i)
+      thread_join(pool[i].handle);
+
+  elapsed = Time::now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
 
   cerr << "\n==========================="
+       << "\nWorkers         : " << pool.size()
+       << "\nPositions       : " << job.positions
        << "\nTotal time (ms) : " << elapsed
-       << "\nNodes searched  : " << nodes
-       << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+       << "\nPositions/second: " << 1000 * job.positions / elapsed;
+
+  if (job.mode != BATCH_EVAL) // Static evaluations search no nodes
+      cerr << "\nNodes searched  : " << job.nodes
+           << "\nNodes/second    : " << 1000 * job.nodes / elapsed;
+
+  cerr << endl;
+}
+
+
+/// evalcheck() compares evaluate() with its scalar reference, see
+/// Eval::evaluate_scalar(), on the positions of a file with one FEN per line
+/// (the bench positions by default) and prints the positions where they differ.
+/// Builds with SIMD kernels, e.g. avx2=yes, must report no mismatch.
+
+void evalcheck(istream& is) {
+
+  string token, fen;
+  vector<string> fens;
+
+  string fenFile = (is >> token) ? token : "default";
+
+  if (fenFile == "default")
+      fens.assign(Defaults, Defaults + 37);
+
+  else
+  {
+      ifstream file(fenFile.c_str());
+
+      if (!file.is_open())
+      {
+          cerr << "Unable to open file " << fenFile << endl;
+          return;
+      }
+
+      while (getline(file, fen))
+          if (!fen.empty())
+              fens.push_back(fen);
+  }
+
+  UCIEngine.threads.wait_for_think_finished(); // Tracing state is not thread safe
+
+  bool chess960 = Options["UCI_Chess960"];
+  size_t checked = 0, mismatches = 0;
+  Position pos;
+
+  for (size_t i = 0; i < fens.size(); ++i)
+  {
+      pos.set(fens[i], chess960, UCIEngine.threads.main());
+
+      if (pos.checkers()) // No static eval when in check
+          continue;
+
+      Value v = Eval::evaluate(pos), ref = Eval::evaluate_scalar(pos);
+
+      ++checked;
+
+      if (v != ref)
+      {
+          ++mismatches;
+          sync_cout << "info string evalcheck " << fens[i] << " : "
+                    << v << " instead of " << ref << sync_endl;
+      }
+  }
+
+  cerr << "\n==========================="
+       << "\nKernels         : " << (HasAvx2 ? "AVX2" : "scalar")
+       << "\nPositions       : " << checked
+       << "\nMismatches      : " << mismatches << endl;
 }
@@ -360,6 +360,19 @@ void Bitboards::init() {
 
 ///emscripten_run_script("console.timeEnd('bitboard1')");
 
+  // The slider tables below are baked for the 32-bit magic index used by the
+  // JS build. Native 64-bit and pext builds index them differently, so there
+  // we compute the magics at startup as upstream does.
+  if (Is64Bit || HasPext)
+  {
+      Square RookDeltas[] = { DELTA_N,  DELTA_E,  DELTA_S,  DELTA_W  };
+      Square BishopDeltas[] = { DELTA_NE, DELTA_SE, DELTA_SW, DELTA_NW };
+
+      init_magics(RookTable, RookAttacks, RookMagics, RookMasks, RookShifts, RookDeltas, magic_index<ROOK>);
+      init_magics(BishopTable, BishopAttacks, BishopMagics, BishopMasks, BishopShifts, BishopDeltas, magic_index<BISHOP>);
+      return;
+  }
+
 /// /*
 RookAttacks[0] = RookTable;
 RookAttacks[1] = RookAttacks[0] + 4096;
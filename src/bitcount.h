@@ -102,4 +102,37 @@ inline int popcount<CNT_HW_POPCNT>(Bitboard b) {
 #endif
 }
 
+
+/// popcount4() counts the non-zero bits of four bitboards at once, with the
+/// nibble lookup of Wojciech Mula: each byte is split in two nibbles that index
+/// a table of bit counts held in a register, then the byte counts of each
+/// bitboard are summed by _mm256_sad_epu8(). Used only when HasAvx2 is set.
+
+inline void popcount4(const Bitboard* b, int* cnt) {
+
+#ifndef USE_AVX2
+
+  assert(false);
+  cnt[0] = b != 0; // Avoid 'b not used' warning
+
+#else
+
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i lowMask = _mm256_set1_epi8(0x0F);
+
+  __m256i v  = _mm256_loadu_si256((const __m256i*)b);
+  __m256i lo = _mm256_and_si256(v, lowMask);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask);
+  __m256i c  = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                               _mm256_shuffle_epi8(lookup, hi));
+
+  // One sum per 64 bit lane, then the low halves of the lanes to four ints
+  c = _mm256_sad_epu8(c, _mm256_setzero_si256());
+  c = _mm256_permutevar8x32_epi32(c, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+  _mm_storeu_si128((__m128i*)cnt, _mm256_castsi256_si128(c));
+
+#endif
+}
+
 #endif // #ifndef BITCOUNT_H_INCLUDED
@@ -0,0 +1,65 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "engine.h"
+#include "uci.h"
+
+Engine UCIEngine; // Global object
+
+
+/// Engine c'tor makes the engine use its own transposition table, unless it is
+/// given the table of another engine to share, and as many threads as set by
+/// the "Threads" option unless a thread count is given.
+
+Engine::Engine(TranspositionTable* sharedTT, size_t fixedThreads)
+  : tt(sharedTT ? sharedTT : &ownTT), threadCount(fixedThreads), silent(false) {}
+
+
+/// Engine::init() launches the threads and allocates the transposition table
+/// when the engine owns it. It must be called after the UCI options are set up.
+
+void Engine::init() {
+
+  resize_pawn_hash(Options["Pawn Hash"]);
+  threads.init(this);
+
+  if (owns_tt())
+      tt->resize(Options["Hash"]);
+}
+
+
+/// Engine::resize_pawn_hash() sets up the pawn and material tables shared by
+/// the threads, three quarters of the memory going to the pawn table. A zero
+/// size frees them and the threads use their own tables again. It must not be
+/// called during a search.
+
+void Engine::resize_pawn_hash(size_t mbSize) {
+
+  pawnsTable.resize(mbSize * 1024 * 1024 / 4 * 3);
+  materialTable.resize(mbSize * 1024 * 1024 / 4);
+}
+
+
+/// Engine::exit() waits for the search to finish and terminates the threads
+
+void Engine::exit() {
+
+  threads.wait_for_think_finished(); // Cannot quit whilst the search is running
+  threads.exit();
+}
@@ -0,0 +1,83 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ENGINE_H_INCLUDED
+#define ENGINE_H_INCLUDED
+
+#include "movepick.h"
+#include "position.h"
+#include "search.h"
+#include "thread.h"
+#include "timeman.h"
+#include "tt.h"
+
+/// Engine struct keeps together all the state of one engine: its threads, its
+/// transposition table and everything the search needs between two nodes or
+/// two iterations. Several engines can live side by side in one process, each
+/// one with its own table or sharing the table of another engine, whose owner
+/// alone starts a new generation of the table for a search. UCI options,
+/// evaluation weights and the precomputed tables are still process wide.
+
+struct Engine {
+
+  explicit Engine(TranspositionTable* sharedTT = NULL, size_t fixedThreads = 0);
+  void init(); // No c'tor and d'tor work, threads rely on globals that should
+  void exit(); // be initialized and valid during the whole engine lifetime.
+  void resize_pawn_hash(size_t mbSize);
+  bool owns_tt() const { return tt == &ownTT; }
+
+  // Search input and output, set by ThreadPool::start_thinking()
+  volatile Search::SignalsType signals;
+  Search::LimitsType limits;
+  Search::RootMoveVector rootMoves;
+  Position rootPos;
+  Time::point searchTime;
+  Search::StateStackPtr setupStates;
+
+  ThreadPool threads;
+  TranspositionTable* tt;
+  Pawns::SharedTable pawnsTable;       // Used instead of the tables of the
+  Material::SharedTable materialTable; // threads when Options["Pawn Hash"] > 0
+  size_t threadCount; // Fixed size of the pool, 0 to follow Options["Threads"]
+  bool silent;        // No UCI output, results are read from rootMoves
+
+  // Search internals shared by all the threads of the engine
+  TimeManager timeMgr;
+  size_t multiPV, pvIdx;
+  double bestMoveChanges;
+  Value drawValue[COLOR_NB];
+  HistoryStats history;
+  GainsStats gains;
+  MovesStats countermoves, followupmoves;
+  Search::PVTable pvTable;
+
+  /// Stockfish.js: iterative deepening state kept between async_loop() calls.
+  /// The stack lives here to prevent garbage collection.
+  Depth depth;
+  Value bestValue, alpha, beta, delta;
+  Search::Stack stack[MAX_PLY+4], *ss;
+  Search::Skill skill;
+
+private:
+  TranspositionTable ownTT;
+};
+
+extern Engine UCIEngine; // The engine driven by the UCI commands
+
+#endif // #ifndef ENGINE_H_INCLUDED
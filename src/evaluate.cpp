@@ -27,6 +27,7 @@
 #include "evaluate.h"
 #include "material.h"
 #include "pawns.h"
+#include "thread.h"
 #include "uci.h" /// Stockfish.js
 
 namespace {
@@ -95,6 +96,10 @@ namespace {
     {289, 344}, {233, 201}, {221, 273}, {46, 0}, {321, 0} /// Changes here must be made below (TODO: Find a way to copy this so we can merge eaiser.)
   };
 
+  // True when all the UCI eval options are at their default values, so that
+  // evaluate() can use the version with the weights folded in at compile time.
+  bool WeightsAreDefault;
+
   #define V(v) Value(v)
   #define S(mg, eg) make_score(mg, eg)
   
@@ -106,8 +111,8 @@ namespace {
   //
   ///NOTE: This was deleted upstream. It should match the Weight struct above.
   ///      Also, Weight is a const upstream.
-  const Score WeightsInternal[] = {
-    S(289, 344), S(233, 201), S(221, 273), S(46, 0), S(321, 0)
+  const Weight WeightsInternal[] = {
+    {289, 344}, {233, 201}, {221, 273}, {46, 0}, {321, 0}
   };
 
   // MobilityBonus[PieceType][attacked] contains bonuses for middle and end
@@ -209,6 +214,11 @@ namespace {
   const int BishopCheck       = 7;
   const int KnightCheck       = 14;
 
+  // If material, imbalance and pawn structure alone put the score farther
+  // than LazyMargin outside the search window, the remaining terms are not
+  // computed.
+  const Value LazyMargin = Value(800);
+
   // KingDanger[attackUnits] contains the actual king danger weighted
   // scores, indexed by a calculated integer number.
   Score KingDanger[512];
@@ -218,12 +228,20 @@ namespace {
     return make_score(mg_value(s) * w.mg / 256, eg_value(s) * w.eg / 256);
   }
 
+  // With DefaultWeights the weight of evaluation term 'Term' is a constant, so
+  // the multiplications are done with immediates and nothing is read from the
+  // Weights[] table.
+  template<int Term, bool DefaultWeights>
+  Score apply_weight(Score s) {
+    return apply_weight(s, DefaultWeights ? WeightsInternal[Term] : Weights[Term]);
+  }
+
   /// Re-added
   // weight_option() computes the value of an evaluation weight, by combining
   // two UCI-configurable weights (midgame and endgame) with an internal weight.
-  Weight weight_option(const std::string& mgOpt, const std::string& egOpt, Score internalWeight) {
-    Weight w = { Options[mgOpt] * mg_value(internalWeight) / 100,
-                 Options[egOpt] * eg_value(internalWeight) / 100 };
+  Weight weight_option(const std::string& mgOpt, const std::string& egOpt, const Weight& internalWeight) {
+    Weight w = { Options[mgOpt] * internalWeight.mg / 100,
+                 Options[egOpt] * internalWeight.eg / 100 };
     return w;
   }
 
@@ -281,13 +299,19 @@ namespace {
   }
 
 
-  // evaluate_pieces() assigns bonuses and penalties to the pieces of a given color
+  // evaluate_pieces() assigns bonuses and penalties to the pieces of a given color.
+  // The attacks of all the pieces are computed first, so that with AVX2 their
+  // mobility and king zone popcounts are done four at a time by popcount4().
+  // Tracing keeps the scalar popcounts, the reference checked by 'evalcheck'.
 
   template<PieceType Pt, Color Us, bool Trace>
   Score evaluate_pieces(const Position& pos, EvalInfo& ei, Score* mobility, Bitboard* mobilityArea) {
 
-    Bitboard b;
-    Square s;
+    const bool Simd = HasAvx2 && !Trace;
+
+    Bitboard b, counted[2 * 16 + 2]; // Mobility and king zone of each piece, padded
+    int counts[2 * 16 + 2], n = 0;
+    Square s, squares[16];
     Score score = SCORE_ZERO;
 
     const PieceType NextPt = (Us == WHITE ? Pt : PieceType(Pt + 1));
@@ -308,13 +332,13 @@ namespace {
 
         ei.attackedBy[Us][ALL_PIECES] |= ei.attackedBy[Us][Pt] |= b;
 
+        Bitboard kingZone = 0;
+
         if (b & ei.kingRing[Them])
         {
             ei.kingAttackersCount[Us]++;
             ei.kingAttackersWeight[Us] += KingAttackWeights[Pt];
-            Bitboard bb = b & ei.attackedBy[Them][KING];
-            if (bb)
-                ei.kingAdjacentZoneAttacksCount[Us] += popcount<Max15>(bb);
+            kingZone = b & ei.attackedBy[Them][KING];
         }
 
         if (Pt == QUEEN)
@@ -322,9 +346,34 @@ namespace {
                    | ei.attackedBy[Them][BISHOP]
                    | ei.attackedBy[Them][ROOK]);
 
-        int mob = Pt != QUEEN ? popcount<Max15>(b & mobilityArea[Us])
-                              : popcount<Full >(b & mobilityArea[Us]);
+        squares[n] = s;
+        counted[2 * n] = b & mobilityArea[Us];
+        counted[2 * n + 1] = kingZone;
+
+        if (!Simd)
+        {
+            counts[2 * n] = Pt != QUEEN ? popcount<Max15>(counted[2 * n])
+                                        : popcount<Full >(counted[2 * n]);
+            counts[2 * n + 1] = kingZone ? popcount<Max15>(kingZone) : 0;
+        }
+
+        ++n;
+    }
 
+    if (Simd)
+    {
+        counted[2 * n] = counted[2 * n + 1] = 0;
+
+        for (int i = 0; i < 2 * n; i += 4)
+            popcount4(counted + i, counts + i);
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        s = squares[i];
+        int mob = counts[2 * i];
+
+        ei.kingAdjacentZoneAttacksCount[Us] += counts[2 * i + 1];
         mobility[Us] += MobilityBonus[Pt][mob];
 
         // Decrease score if we are attacked by an enemy pawn. The remaining part
@@ -571,7 +620,7 @@ namespace {
 
   // evaluate_passed_pawns() evaluates the passed pawns of the given color
 
-  template<Color Us, bool Trace>
+  template<Color Us, bool Trace, bool DefaultWeights>
   Score evaluate_passed_pawns(const Position& pos, const EvalInfo& ei) {
 
     const Color Them = (Us == WHITE ? BLACK : WHITE);
@@ -649,7 +698,7 @@ namespace {
         Tracing::write(Tracing::PASSED, Us, apply_weight(score, Weights[PassedPawns]));
 
     // Add the scores to the middlegame and endgame eval
-    return apply_weight(score, Weights[PassedPawns]);
+    return apply_weight<PassedPawns, DefaultWeights>(score);
   }
 
 
@@ -689,10 +738,62 @@ namespace {
   }
 
 
-  // do_evaluate() is the evaluation entry point, called directly from evaluate()
+  // scale_factor() returns the scale factor of the endgame score 'score',
+  // which is lower when the position is more drawish than it appears.
+
+  ScaleFactor scale_factor(const Position& pos, const EvalInfo& ei, Score score) {
+
+    Color strongSide = eg_value(score) > VALUE_DRAW ? WHITE : BLACK;
+    ScaleFactor sf = ei.mi->scale_factor(pos, strongSide);
+
+    // If we don't already have an unusual scale factor, check for certain
+    // types of endgames, and use a lower scale for those.
+    if (    ei.mi->game_phase() < PHASE_MIDGAME
+        && (sf == SCALE_FACTOR_NORMAL || sf == SCALE_FACTOR_ONEPAWN))
+    {
+        if (pos.opposite_bishops())
+        {
+            // Endgame with opposite-colored bishops and no other pieces (ignoring pawns)
+            // is almost a draw, in case of KBP vs KB is even more a draw.
+            if (   pos.non_pawn_material(WHITE) == BishopValueMg
+                && pos.non_pawn_material(BLACK) == BishopValueMg)
+                sf = more_than_one(pos.pieces(PAWN)) ? ScaleFactor(32) : ScaleFactor(8);
+
+            // Endgame with opposite-colored bishops, but also other pieces. Still
+            // a bit drawish, but not as drawish as with only the two bishops.
+            else
+                 sf = ScaleFactor(50 * sf / SCALE_FACTOR_NORMAL);
+        }
+        // Endings where weaker side can place his king in front of the opponent's
+        // pawns are drawish.
+        else if (    abs(eg_value(score)) <= BishopValueEg
+                 &&  ei.pi->pawn_span(strongSide) <= 1
+                 && !pos.pawn_passed(~strongSide, pos.king_square(~strongSide)))
+                 sf = ei.pi->pawn_span(strongSide) ? ScaleFactor(56) : ScaleFactor(38);
+    }
+
+    return sf;
+  }
+
+
+  // interpolate() returns the value of 'score' at game phase 'ph', between its
+  // middlegame and its endgame value scaled by 'sf'.
+
+  Value interpolate(Score score, Phase ph, ScaleFactor sf) {
 
-  template<bool Trace>
-  Value do_evaluate(const Position& pos) {
+    Value v =  mg_value(score) * int(ph)
+             + eg_value(score) * int(PHASE_MIDGAME - ph) * sf / SCALE_FACTOR_NORMAL;
+
+    return v / int(PHASE_MIDGAME);
+  }
+
+
+  // do_evaluate() is the evaluation entry point, called directly from evaluate().
+  // It sets 'lazy' when it returns early because the score is outside the
+  // window (alpha, beta).
+
+  template<bool Trace, bool DefaultWeights>
+  Value do_evaluate(const Position& pos, Value alpha, Value beta, bool& lazy) {
 
     assert(!pos.checkers());
 
@@ -715,7 +816,24 @@ namespace {
 
     // Probe the pawn hash table
     ei.pi = Pawns::probe(pos);
-    score += apply_weight(ei.pi->pawns_score(), Weights[PawnStructure]);
+    score += apply_weight<PawnStructure, DefaultWeights>(ei.pi->pawns_score());
+
+    // Lazy exit: if the cheap terms already settle the outcome, return them
+    // as an approximation, scaled like the full score would be. The remaining
+    // terms are assumed to be worth less than LazyMargin, so the caller takes
+    // the same decision it would take with the full score.
+    if (!Trace)
+    {
+        Value v = interpolate(score, ei.mi->game_phase(), scale_factor(pos, ei, score));
+
+        v = (pos.side_to_move() == WHITE ? v : -v) + Eval::Tempo;
+
+        if (v - LazyMargin >= beta || v + LazyMargin <= alpha)
+        {
+            lazy = true;
+            return v;
+        }
+    }
 
     // Initialize attack and king safety bitboards
     init_eval_info<WHITE>(pos, ei);
@@ -730,7 +848,7 @@ namespace {
 
     // Evaluate pieces and mobility
     score += evaluate_pieces<KNIGHT, WHITE, Trace>(pos, ei, mobility, mobilityArea);
-    score += apply_weight(mobility[WHITE] - mobility[BLACK], Weights[Mobility]);
+    score += apply_weight<Mobility, DefaultWeights>(mobility[WHITE] - mobility[BLACK]);
 
     // Evaluate kings after all other pieces because we need complete attack
     // information when computing the king safety evaluation.
@@ -742,8 +860,8 @@ namespace {
             - evaluate_threats<BLACK, Trace>(pos, ei);
 
     // Evaluate passed pawns, we need full attack information including king
-    score +=  evaluate_passed_pawns<WHITE, Trace>(pos, ei)
-            - evaluate_passed_pawns<BLACK, Trace>(pos, ei);
+    score +=  evaluate_passed_pawns<WHITE, Trace, DefaultWeights>(pos, ei)
+            - evaluate_passed_pawns<BLACK, Trace, DefaultWeights>(pos, ei);
 
     // If both sides have only pawns, score for potential unstoppable pawns
     if (!pos.non_pawn_material(WHITE) && !pos.non_pawn_material(BLACK))
@@ -760,44 +878,13 @@ namespace {
     if (pos.non_pawn_material(WHITE) + pos.non_pawn_material(BLACK) >= 2 * QueenValueMg + 4 * RookValueMg + 2 * KnightValueMg)
     {
         Score s = evaluate_space<WHITE>(pos, ei) - evaluate_space<BLACK>(pos, ei);
-        score += apply_weight(s, Weights[Space]);
+        score += apply_weight<Space, DefaultWeights>(s);
     }
 
-    // Scale winning side if position is more drawish than it appears
-    Color strongSide = eg_value(score) > VALUE_DRAW ? WHITE : BLACK;
-    ScaleFactor sf = ei.mi->scale_factor(pos, strongSide);
-
-    // If we don't already have an unusual scale factor, check for certain
-    // types of endgames, and use a lower scale for those.
-    if (    ei.mi->game_phase() < PHASE_MIDGAME
-        && (sf == SCALE_FACTOR_NORMAL || sf == SCALE_FACTOR_ONEPAWN))
-    {
-        if (pos.opposite_bishops())
-        {
-            // Endgame with opposite-colored bishops and no other pieces (ignoring pawns)
-            // is almost a draw, in case of KBP vs KB is even more a draw.
-            if (   pos.non_pawn_material(WHITE) == BishopValueMg
-                && pos.non_pawn_material(BLACK) == BishopValueMg)
-                sf = more_than_one(pos.pieces(PAWN)) ? ScaleFactor(32) : ScaleFactor(8);
-
-            // Endgame with opposite-colored bishops, but also other pieces. Still
-            // a bit drawish, but not as drawish as with only the two bishops.
-            else
-                 sf = ScaleFactor(50 * sf / SCALE_FACTOR_NORMAL);
-        }
-        // Endings where weaker side can place his king in front of the opponent's
-        // pawns are drawish.
-        else if (    abs(eg_value(score)) <= BishopValueEg
-                 &&  ei.pi->pawn_span(strongSide) <= 1
-                 && !pos.pawn_passed(~strongSide, pos.king_square(~strongSide)))
-                 sf = ei.pi->pawn_span(strongSide) ? ScaleFactor(56) : ScaleFactor(38);
-    }
-
-    // Interpolate between a middlegame and a (scaled by 'sf') endgame score
-    Value v =  mg_value(score) * int(ei.mi->game_phase())
-             + eg_value(score) * int(PHASE_MIDGAME - ei.mi->game_phase()) * sf / SCALE_FACTOR_NORMAL;
-
-    v /= int(PHASE_MIDGAME);
+    // Scale winning side if position is more drawish than it appears, and
+    // interpolate between a middlegame and a (scaled) endgame score.
+    ScaleFactor sf = scale_factor(pos, ei, score);
+    Value v = interpolate(score, ei.mi->game_phase(), sf);
 
     // In case of tracing add all single evaluation contributions for both white and black
     if (Trace)
@@ -856,7 +943,8 @@ namespace {
 
     std::memset(scores, 0, sizeof(scores));
 
-    Value v = do_evaluate<true>(pos);
+    bool lazy = false;
+    Value v = do_evaluate<true, false>(pos, -VALUE_INFINITE, VALUE_INFINITE, lazy);
     v = pos.side_to_move() == WHITE ? v : -v; // White's point of view
 
     std::stringstream ss;
@@ -892,10 +980,26 @@ namespace {
 namespace Eval {
 
   /// evaluate() is the main evaluation function. It returns a static evaluation
-  /// of the position always from the point of view of the side to move.
+  /// of the position always from the point of view of the side to move. When a
+  /// window is given the evaluation may stop early, see do_evaluate(). If 'lazy'
+  /// is not NULL, it tells the caller whether the value is such a partial one.
+
+  Value evaluate(const Position& pos, Value alpha, Value beta, bool* lazy) {
+
+    Thread* th = pos.this_thread();
+    bool partial = false;
+
+    Value v = WeightsAreDefault ? do_evaluate<false,  true>(pos, alpha, beta, partial)
+                                : do_evaluate<false, false>(pos, alpha, beta, partial);
+    ++th->evals;
 
-  Value evaluate(const Position& pos) {
-    return do_evaluate<false>(pos);
+    if (partial)
+        ++th->lazyEvals;
+
+    if (lazy)
+        *lazy = partial;
+
+    return v;
   }
 
 
@@ -908,9 +1012,21 @@ namespace Eval {
   }
 
 
+  /// evaluate_scalar() is evaluate() done along the tracing path, without lazy
+  /// exits and SIMD kernels. It is the reference used by
+  /// the 'evalcheck' command and must not be called during a search.
+
+  Value evaluate_scalar(const Position& pos) {
+
+    bool lazy = false;
+    return do_evaluate<true, false>(pos, -VALUE_INFINITE, VALUE_INFINITE, lazy);
+  }
+
+
   /// init() computes evaluation weights, usually at startup
 
   void init() {
+
     /// Re-added
     Weights[Mobility]       = weight_option("Mobility (Midgame)", "Mobility (Endgame)", WeightsInternal[Mobility]);
     Weights[PawnStructure]  = weight_option("Pawn Structure (Midgame)", "Pawn Structure (Endgame)", WeightsInternal[PawnStructure]);
@@ -918,6 +1034,12 @@ namespace Eval {
     Weights[Space]          = weight_option("Space", "Space", WeightsInternal[Space]);
     Weights[KingSafety]     = weight_option("King Safety", "King Safety", WeightsInternal[KingSafety]);
 
+    WeightsAreDefault = true;
+    for (int i = Mobility; i <= KingSafety; ++i)
+        if (   Weights[i].mg != WeightsInternal[i].mg
+            || Weights[i].eg != WeightsInternal[i].eg)
+            WeightsAreDefault = false;
+
     const double MaxSlope = 7.5;
     const double Peak = 1280;
     double t = 0.0;
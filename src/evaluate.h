@@ -31,8 +31,9 @@ namespace Eval {
 const Value Tempo = Value(17); // Must be visible to search
 
 void init();
-Value evaluate(const Position& pos);
+Value evaluate(const Position& pos, Value alpha = -VALUE_INFINITE, Value beta = VALUE_INFINITE, bool* lazy = NULL);
 std::string trace(const Position& pos);
+Value evaluate_scalar(const Position& pos);
 
 }
 
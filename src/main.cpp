@@ -24,15 +24,20 @@
 */
 
 #include <iostream>
+#include <sstream>
 
 #include "bitboard.h"
+#include "engine.h"
 #include "evaluate.h"
+#include "numa.h"
 #include "position.h"
 #include "search.h"
 #include "thread.h"
 #include "tt.h"
 #include "uci.h"
 
+extern void batch_exit();
+
 extern "C" void init() {
 
   std::cout << engine_info() << std::endl;
@@ -57,13 +62,10 @@ extern "C" void init() {
 ///emscripten_run_script("console.log('pawns');console.time('pawns')");
   Pawns::init();
 ///emscripten_run_script("console.timeEnd('pawns')");
-///emscripten_run_script("console.log('Threads');console.time('Threads')");
-  Threads.init();
-///emscripten_run_script("console.timeEnd('Threads')");
-///emscripten_run_script("console.log('TT');console.time('TT')");
-  TT.resize(Options["Hash"]);
-
-///emscripten_run_script("console.timeEnd('TT')");
+  NUMA::init();
+///emscripten_run_script("console.log('Engine');console.time('Engine')");
+  UCIEngine.init();
+///emscripten_run_script("console.timeEnd('Engine')");
 ///emscripten_run_script("console.log('commandInit');console.time('commandInit')");
   UCI::commandInit();
 ///emscripten_run_script("console.timeEnd('commandInit')");
@@ -80,10 +82,26 @@ int main(int argc, char* argv[]) {
   if(!args.empty())
     UCI::command(args);
 
-#ifndef EMSCRIPTEN
-  std::string cmd;
-  while(std::getline(std::cin, cmd))
-    UCI::command(cmd);
+#ifndef NO_THREADS
+  // Native and js-threads builds search on their own thread, so we keep reading
+  // commands like 'stop' and 'ponderhit' while thinking. Passed args are one-shot.
+  std::string cmd, token;
+
+  if (args.empty())
+      do {
+          if (!std::getline(std::cin, cmd)) // Block here waiting for input or EOF
+              cmd = "quit";
+
+          UCI::command(cmd);
+
+          std::istringstream is(cmd);
+          token.clear();
+          is >> std::skipws >> token;
+
+      } while (token != "quit");
+
+  batch_exit();
+  UCIEngine.exit();
 #endif
 }
 
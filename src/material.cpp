@@ -21,6 +21,7 @@
 #include <cassert>
 #include <cstring>   // For std::memset
 
+#include "engine.h"
 #include "material.h"
 #include "thread.h"
 
@@ -118,120 +119,148 @@ namespace {
 
 namespace Material {
 
-/// Material::probe() looks up the current position's material configuration in
-/// the material hash table. It returns a pointer to the Entry if the position
-/// is found. Otherwise a new Entry is computed and stored there, so we don't
-/// have to recompute all when the same material configuration occurs again.
+namespace {
 
-Entry* probe(const Position& pos) {
+  // compute() fills a new Entry for the material configuration of the position
 
-  Key key = pos.material_key();
-  Entry* e = pos.this_thread()->materialTable[key];
+  void compute(const Position& pos, Entry* e, Endgames& endgames) {
 
-  if (e->key == key)
-      return e;
+    Key key = pos.material_key();
 
-  std::memset(e, 0, sizeof(Entry));
-  e->key = key;
-  e->factor[WHITE] = e->factor[BLACK] = (uint8_t)SCALE_FACTOR_NORMAL;
-  e->gamePhase = pos.game_phase();
+    std::memset(e, 0, sizeof(Entry));
+    e->key = key;
+    e->factor[WHITE] = e->factor[BLACK] = (uint8_t)SCALE_FACTOR_NORMAL;
+    e->gamePhase = pos.game_phase();
 
-  // Let's look if we have a specialized evaluation function for this particular
-  // material configuration. Firstly we look for a fixed configuration one, then
-  // for a generic one if the previous search failed.
-  if (pos.this_thread()->endgames.probe(key, e->evaluationFunction))
-      return e;
+    // Let's look if we have a specialized evaluation function for this particular
+    // material configuration. Firstly we look for a fixed configuration one, then
+    // for a generic one if the previous search failed.
+    if (endgames.probe(key, e->evaluationFunction))
+        return;
 
-  if (is_KXK<WHITE>(pos))
-  {
-      e->evaluationFunction = &EvaluateKXK[WHITE];
-      return e;
-  }
+    if (is_KXK<WHITE>(pos))
+    {
+        e->evaluationFunction = &EvaluateKXK[WHITE];
+        return;
+    }
 
-  if (is_KXK<BLACK>(pos))
-  {
-      e->evaluationFunction = &EvaluateKXK[BLACK];
-      return e;
-  }
+    if (is_KXK<BLACK>(pos))
+    {
+        e->evaluationFunction = &EvaluateKXK[BLACK];
+        return;
+    }
 
-  // OK, we didn't find any special evaluation function for the current material
-  // configuration. Is there a suitable specialized scaling function?
-  EndgameBase<ScaleFactor>* sf;
+    // OK, we didn't find any special evaluation function for the current material
+    // configuration. Is there a suitable specialized scaling function?
+    EndgameBase<ScaleFactor>* sf;
 
-  if (pos.this_thread()->endgames.probe(key, sf))
-  {
-      e->scalingFunction[sf->strong_side()] = sf; // Only strong color assigned
-      return e;
+    if (endgames.probe(key, sf))
+    {
+        e->scalingFunction[sf->strong_side()] = sf; // Only strong color assigned
+        return;
+    }
+
+    // We didn't find any specialized scaling function, so fall back on generic
+    // ones that refer to more than one material distribution. Note that in this
+    // case we don't return after setting the function.
+    if (is_KBPsKs<WHITE>(pos))
+        e->scalingFunction[WHITE] = &ScaleKBPsK[WHITE];
+
+    if (is_KBPsKs<BLACK>(pos))
+        e->scalingFunction[BLACK] = &ScaleKBPsK[BLACK];
+
+    if (is_KQKRPs<WHITE>(pos))
+        e->scalingFunction[WHITE] = &ScaleKQKRPs[WHITE];
+
+    else if (is_KQKRPs<BLACK>(pos))
+        e->scalingFunction[BLACK] = &ScaleKQKRPs[BLACK];
+
+    Value npm_w = pos.non_pawn_material(WHITE);
+    Value npm_b = pos.non_pawn_material(BLACK);
+
+    if (npm_w + npm_b == VALUE_ZERO && pos.pieces(PAWN)) // Only pawns on the board
+    {
+        if (!pos.count<PAWN>(BLACK))
+        {
+            assert(pos.count<PAWN>(WHITE) >= 2);
+
+            e->scalingFunction[WHITE] = &ScaleKPsK[WHITE];
+        }
+        else if (!pos.count<PAWN>(WHITE))
+        {
+            assert(pos.count<PAWN>(BLACK) >= 2);
+
+            e->scalingFunction[BLACK] = &ScaleKPsK[BLACK];
+        }
+        else if (pos.count<PAWN>(WHITE) == 1 && pos.count<PAWN>(BLACK) == 1)
+        {
+            // This is a special case because we set scaling functions
+            // for both colors instead of only one.
+            e->scalingFunction[WHITE] = &ScaleKPKP[WHITE];
+            e->scalingFunction[BLACK] = &ScaleKPKP[BLACK];
+        }
+    }
+
+    // Zero or just one pawn makes it difficult to win, even with a small material
+    // advantage. This catches some trivial draws like KK, KBK and KNK and gives a
+    // drawish scale factor for cases such as KRKBP and KmmKm (except for KBBKN).
+    if (!pos.count<PAWN>(WHITE) && npm_w - npm_b <= BishopValueMg)
+        e->factor[WHITE] = uint8_t(npm_w <  RookValueMg   ? SCALE_FACTOR_DRAW :
+                                   npm_b <= BishopValueMg ? 4 : 12);
+
+    if (!pos.count<PAWN>(BLACK) && npm_b - npm_w <= BishopValueMg)
+        e->factor[BLACK] = uint8_t(npm_b <  RookValueMg   ? SCALE_FACTOR_DRAW :
+                                   npm_w <= BishopValueMg ? 4 : 12);
+
+    if (pos.count<PAWN>(WHITE) == 1 && npm_w - npm_b <= BishopValueMg)
+        e->factor[WHITE] = (uint8_t) SCALE_FACTOR_ONEPAWN;
+
+    if (pos.count<PAWN>(BLACK) == 1 && npm_b - npm_w <= BishopValueMg)
+        e->factor[BLACK] = (uint8_t) SCALE_FACTOR_ONEPAWN;
+
+    // Evaluate the material imbalance. We use PIECE_TYPE_NONE as a place holder
+    // for the bishop pair "extended piece", which allows us to be more flexible
+    // in defining bishop pair bonuses.
+    const int PieceCount[COLOR_NB][PIECE_TYPE_NB] = {
+    { pos.count<BISHOP>(WHITE) > 1, pos.count<PAWN>(WHITE), pos.count<KNIGHT>(WHITE),
+      pos.count<BISHOP>(WHITE)    , pos.count<ROOK>(WHITE), pos.count<QUEEN >(WHITE) },
+    { pos.count<BISHOP>(BLACK) > 1, pos.count<PAWN>(BLACK), pos.count<KNIGHT>(BLACK),
+      pos.count<BISHOP>(BLACK)    , pos.count<ROOK>(BLACK), pos.count<QUEEN >(BLACK) } };
+
+    e->value = int16_t((imbalance<WHITE>(PieceCount) - imbalance<BLACK>(PieceCount)) / 16);
   }
 
-  // We didn't find any specialized scaling function, so fall back on generic
-  // ones that refer to more than one material distribution. Note that in this
-  // case we don't return after setting the function.
-  if (is_KBPsKs<WHITE>(pos))
-      e->scalingFunction[WHITE] = &ScaleKBPsK[WHITE];
+} // namespace
+
 
-  if (is_KBPsKs<BLACK>(pos))
-      e->scalingFunction[BLACK] = &ScaleKBPsK[BLACK];
+/// Material::probe() looks up the current position's material configuration in
+/// the material hash table. It returns a pointer to the Entry if the position
+/// is found. Otherwise a new Entry is computed and stored there, so we don't
+/// have to recompute all when the same material configuration occurs again.
+/// With a table shared by the threads, the Entry is a copy owned by the thread.
 
-  if (is_KQKRPs<WHITE>(pos))
-      e->scalingFunction[WHITE] = &ScaleKQKRPs[WHITE];
+Entry* probe(const Position& pos) {
 
-  else if (is_KQKRPs<BLACK>(pos))
-      e->scalingFunction[BLACK] = &ScaleKQKRPs[BLACK];
+  Key key = pos.material_key();
+  Thread* thisThread = pos.this_thread();
+  SharedTable& shared = thisThread->engine->materialTable;
+  Entry* e = shared.enabled() ? &thisThread->materialEntry : thisThread->materialTable[key];
 
-  Value npm_w = pos.non_pawn_material(WHITE);
-  Value npm_b = pos.non_pawn_material(BLACK);
+  ++thisThread->materialProbes;
 
-  if (npm_w + npm_b == VALUE_ZERO && pos.pieces(PAWN)) // Only pawns on the board
+  if (shared.enabled() ? shared.probe(key, *e) : e->key == key)
   {
-      if (!pos.count<PAWN>(BLACK))
-      {
-          assert(pos.count<PAWN>(WHITE) >= 2);
-
-          e->scalingFunction[WHITE] = &ScaleKPsK[WHITE];
-      }
-      else if (!pos.count<PAWN>(WHITE))
-      {
-          assert(pos.count<PAWN>(BLACK) >= 2);
-
-          e->scalingFunction[BLACK] = &ScaleKPsK[BLACK];
-      }
-      else if (pos.count<PAWN>(WHITE) == 1 && pos.count<PAWN>(BLACK) == 1)
-      {
-          // This is a special case because we set scaling functions
-          // for both colors instead of only one.
-          e->scalingFunction[WHITE] = &ScaleKPKP[WHITE];
-          e->scalingFunction[BLACK] = &ScaleKPKP[BLACK];
-      }
+      ++thisThread->materialHits;
+      return e;
   }
 
-  // Zero or just one pawn makes it difficult to win, even with a small material
-  // advantage. This catches some trivial draws like KK, KBK and KNK and gives a
-  // drawish scale factor for cases such as KRKBP and KmmKm (except for KBBKN).
-  if (!pos.count<PAWN>(WHITE) && npm_w - npm_b <= BishopValueMg)
-      e->factor[WHITE] = uint8_t(npm_w <  RookValueMg   ? SCALE_FACTOR_DRAW :
-                                 npm_b <= BishopValueMg ? 4 : 12);
-
-  if (!pos.count<PAWN>(BLACK) && npm_b - npm_w <= BishopValueMg)
-      e->factor[BLACK] = uint8_t(npm_b <  RookValueMg   ? SCALE_FACTOR_DRAW :
-                                 npm_w <= BishopValueMg ? 4 : 12);
-
-  if (pos.count<PAWN>(WHITE) == 1 && npm_w - npm_b <= BishopValueMg)
-      e->factor[WHITE] = (uint8_t) SCALE_FACTOR_ONEPAWN;
-
-  if (pos.count<PAWN>(BLACK) == 1 && npm_b - npm_w <= BishopValueMg)
-      e->factor[BLACK] = (uint8_t) SCALE_FACTOR_ONEPAWN;
-
-  // Evaluate the material imbalance. We use PIECE_TYPE_NONE as a place holder
-  // for the bishop pair "extended piece", which allows us to be more flexible
-  // in defining bishop pair bonuses.
-  const int PieceCount[COLOR_NB][PIECE_TYPE_NB] = {
-  { pos.count<BISHOP>(WHITE) > 1, pos.count<PAWN>(WHITE), pos.count<KNIGHT>(WHITE),
-    pos.count<BISHOP>(WHITE)    , pos.count<ROOK>(WHITE), pos.count<QUEEN >(WHITE) },
-  { pos.count<BISHOP>(BLACK) > 1, pos.count<PAWN>(BLACK), pos.count<KNIGHT>(BLACK),
-    pos.count<BISHOP>(BLACK)    , pos.count<ROOK>(BLACK), pos.count<QUEEN >(BLACK) } };
-
-  e->value = int16_t((imbalance<WHITE>(PieceCount) - imbalance<BLACK>(PieceCount)) / 16);
+  // The endgame functions of a shared entry must outlive the thread that
+  // computed it, the main thread is never deleted before the engine exits.
+  compute(pos, e, shared.enabled() ? thisThread->engine->threads.main()->endgames
+                                   : thisThread->endgames);
+  if (shared.enabled())
+      shared.store(*e);
+
   return e;
 }
 
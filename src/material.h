@@ -64,6 +64,7 @@ struct Entry {
 };
 
 typedef HashTable<Entry, 8192> Table;
+typedef SharedHashTable<Entry> SharedTable;
 
 Entry* probe(const Position& pos);
 
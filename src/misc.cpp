@@ -17,6 +17,14 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#if defined(__linux__) && !defined(EMSCRIPTEN)
+#  include <sys/mman.h>
+#elif defined(_WIN32)
+#  include <malloc.h> // For _aligned_malloc()
+#endif
+
+#include <cstdlib>
+#include <cstring>   // For std::memset
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -116,6 +124,7 @@ const string engine_info(bool to_uci) {
 
   ss << (Is64Bit ? " 64" : "")
      << (HasPext ? " BMI2" : (HasPopCnt ? " POPCNT" : ""))
+     << (HasAvx2 ? " AVX2" : "")
      << (to_uci  ? "\nid author ": " by ")
      << "Tord Romstad, Marco Costalba and Joona Kiiski";
 
@@ -206,3 +215,105 @@ void prefetch(char* addr) {
 }
 
 #endif
+
+
+/// large_pages_alloc() returns 'size' bytes of zeroed memory aligned to a cache
+/// line at least, or NULL, and describes in 'pages' how the memory is backed.
+/// On Linux the memory is mapped from the huge page pool (MAP_HUGETLB) when it
+/// has enough free pages, otherwise it is aligned to a huge page and advised
+/// (MADV_HUGEPAGE) for transparent huge pages. Elsewhere it is a plain aligned
+/// allocation. Memory must be given back with large_pages_free() and the same
+/// size.
+
+#if defined(__linux__) && !defined(EMSCRIPTEN)
+
+void* large_pages_alloc(size_t size, string& pages) {
+
+  const size_t HugePageSize = 2 * 1024 * 1024;
+  size_t hugeSize = (size + HugePageSize - 1) & ~(HugePageSize - 1);
+  char* mem;
+
+  if (size >= HugePageSize)
+  {
+      mem = (char*)mmap(NULL, hugeSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+      if (mem != MAP_FAILED)
+      {
+          pages = "2048 kB pages (MAP_HUGETLB)";
+          return mem;
+      }
+
+      // Map one more huge page and trim the ends, so that the memory is
+      // aligned to a huge page and it can be entirely backed by them.
+      mem = (char*)mmap(NULL, hugeSize + HugePageSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+      if (mem == MAP_FAILED)
+          return NULL;
+
+      size_t head = (HugePageSize - uintptr_t(mem) % HugePageSize) % HugePageSize;
+
+      if (head)
+          munmap(mem, head);
+
+      munmap(mem + head + hugeSize, HugePageSize - head);
+      mem += head;
+
+      string mode;
+      ifstream thp("/sys/kernel/mm/transparent_hugepage/enabled");
+      getline(thp, mode);
+
+      if (   !madvise(mem, hugeSize, MADV_HUGEPAGE)
+          && mode.find("[never]") == string::npos)
+      {
+          pages = "2048 kB pages (transparent, madvise)";
+          return mem;
+      }
+
+      munmap(mem, hugeSize);
+  }
+
+  mem = (char*)mmap(NULL, hugeSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  pages = "4 kB pages";
+  return mem != MAP_FAILED ? mem : NULL;
+}
+
+void large_pages_free(void* mem, size_t size) {
+
+  const size_t HugePageSize = 2 * 1024 * 1024;
+
+  if (mem)
+      munmap(mem, (size + HugePageSize - 1) & ~(HugePageSize - 1));
+}
+
+#else
+
+void* large_pages_alloc(size_t size, string& pages) {
+
+  void* mem;
+  pages = "default pages";
+
+#  ifdef _WIN32
+  if (!(mem = _aligned_malloc(size, 64)))
+      return NULL;
+#  else
+  if (posix_memalign(&mem, 64, size))
+      return NULL;
+#  endif
+
+  return std::memset(mem, 0, size);
+}
+
+void large_pages_free(void* mem, size_t) {
+
+#  ifdef _WIN32
+  _aligned_free(mem);
+#  else
+  free(mem);
+#  endif
+}
+
+#endif
@@ -21,6 +21,7 @@
 #define MISC_H_INCLUDED
 
 #include <cassert>
+#include <cstring>
 #include <ostream>
 #include <string>
 #include <vector>
@@ -31,6 +32,8 @@ const std::string engine_info(bool to_uci = false);
 void timed_wait(WaitCondition&, Lock&, int);
 void prefetch(char* addr);
 void start_logger(bool b);
+void* large_pages_alloc(size_t size, std::string& pages);
+void large_pages_free(void* mem, size_t size);
 
 void dbg_hit_on(bool b);
 void dbg_hit_on_c(bool c, bool b);
@@ -48,12 +51,88 @@ template<class Entry, int Size>
 struct HashTable {
   HashTable() : table(Size, Entry()) {}
   Entry* operator[](Key key) { return &table[(uint32_t)key & (Size - 1)]; }
+  size_t bytes() const { return Size * sizeof(Entry); }
 
 private:
   std::vector<Entry> table;
 };
 
 
+/// SharedHashTable is a HashTable shared by all the threads of an engine, and
+/// sized at run time. Entries are copied in and out of it: a checksum of the
+/// entry words is stored along with them, so that a copy torn by a concurrent
+/// store() reads as a miss and no locks are needed. Entry must be a POD with a
+/// 'key' member.
+
+template<class Entry>
+struct SharedHashTable {
+
+  bool enabled() const { return !table.empty(); }
+
+  // The slot of the key, to be prefetched before probe()
+  char* slot(Key key) {
+    return (char*)&table[(size_t)key & (table.size() - 1)];
+  }
+
+  void resize(size_t bytes) {
+
+    size_t count = 1;
+
+    while (2 * count * sizeof(Slot) <= bytes)
+        count *= 2;
+
+    table.clear(); // Free the old table before allocating the new one
+    table.resize(bytes >= sizeof(Slot) ? count : 0, Slot());
+  }
+
+  bool probe(Key key, Entry& e) const {
+
+    const Slot& s = table[(size_t)key & (table.size() - 1)];
+    uint64_t w[Words], check = s.check;
+
+    for (int i = 0; i < Words; ++i)
+        w[i] = s.words[i];
+
+    std::memcpy(&e, w, sizeof(Entry));
+    return e.key == key && checksum(w) == check;
+  }
+
+  void store(const Entry& e) {
+
+    Slot& s = table[(size_t)e.key & (table.size() - 1)];
+    uint64_t w[Words];
+
+    w[Words - 1] = 0; // Padding of the last word
+    std::memcpy(w, &e, sizeof(Entry));
+
+    for (int i = 0; i < Words; ++i)
+        s.words[i] = w[i];
+
+    s.check = checksum(w);
+  }
+
+private:
+  static const int Words = (sizeof(Entry) + 7) / 8;
+
+  struct Slot {
+    volatile uint64_t check;
+    volatile uint64_t words[Words];
+  };
+
+  static uint64_t checksum(const uint64_t* w) {
+
+    uint64_t c = 0x9E3779B97F4A7C15ULL; // A zeroed slot is not valid
+
+    for (int i = 0; i < Words; ++i)
+        c ^= w[i] * (2 * i + 1);
+
+    return c;
+  }
+
+  std::vector<Slot> table;
+};
+
+
 enum SyncCout { IO_LOCK, IO_UNLOCK };
 std::ostream& operator<<(std::ostream&, SyncCout);
 
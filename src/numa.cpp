@@ -0,0 +1,202 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#if defined(__linux__) && !defined(EMSCRIPTEN)
+#  include <sched.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#  define USE_NUMA
+#endif
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "numa.h"
+
+namespace {
+
+  std::vector<int> NodeIds; // Kernel ids of the nodes, may have holes
+  std::vector<std::vector<int> > NodeCpus; // CPUs of each node
+
+#ifdef USE_NUMA
+
+  // Memory policies from <numaif.h>, which is not always installed
+  const int MPOL_BIND_ = 2;
+  const int MPOL_INTERLEAVE_ = 3;
+  const unsigned MPOL_MF_MOVE_ = 1 << 1;
+
+  cpu_set_t InitialCpus; // Restored by bind_this_thread(-1)
+
+
+  // read_list() parses a sysfs list like "0-3,8-11" into its numbers
+
+  std::vector<int> read_list(const std::string& path) {
+
+    std::vector<int> list;
+    std::ifstream file(path.c_str());
+    std::string range;
+
+    while (std::getline(file, range, ','))
+    {
+        int first, last;
+        char dash;
+        std::istringstream is(range);
+
+        if (!(is >> first))
+            continue;
+
+        last = (is >> dash >> last) ? last : first;
+
+        for (int i = first; i <= last; ++i)
+            list.push_back(i);
+    }
+
+    return list;
+  }
+
+
+  // cpu_set() returns the CPUs of a node, or the initial ones if node < 0
+
+  cpu_set_t cpu_set(int node) {
+
+    if (node < 0 || node >= NUMA::nodes())
+        return InitialCpus;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (size_t i = 0; i < NodeCpus[node].size(); ++i)
+        CPU_SET(NodeCpus[node][i], &set);
+
+    return set;
+  }
+
+
+  // mbind() applies a memory policy to the whole pages inside [mem, mem + size)
+
+  void mbind(void* mem, size_t size, int mode, unsigned long nodeMask) {
+
+    const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t(mem) + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t end = (uintptr_t(mem) + size) & ~(pageSize - 1);
+
+    if (begin < end)
+        syscall(SYS_mbind, begin, end - begin, mode, &nodeMask, sizeof(nodeMask) * 8, MPOL_MF_MOVE_);
+  }
+
+#endif
+
+} // namespace
+
+
+/// NUMA::init() reads the nodes and their CPUs. Nodes with ids above 63 are not
+/// used, so that a node mask fits in a single word.
+
+void NUMA::init() {
+
+#ifdef USE_NUMA
+  sched_getaffinity(0, sizeof(InitialCpus), &InitialCpus);
+
+  std::vector<int> ids = read_list("/sys/devices/system/node/online");
+
+  for (size_t i = 0; i < ids.size(); ++i)
+      if (ids[i] < 64)
+      {
+          std::ostringstream path;
+          path << "/sys/devices/system/node/node" << ids[i] << "/cpulist";
+          NodeIds.push_back(ids[i]);
+          NodeCpus.push_back(read_list(path.str()));
+      }
+#endif
+}
+
+
+/// NUMA::nodes() returns the number of nodes, at least 1
+
+int NUMA::nodes() {
+
+  return NodeCpus.empty() ? 1 : int(NodeCpus.size());
+}
+
+
+/// NUMA::node_of() returns the node of the thread 'idx' out of 'threadCount'.
+/// Threads are given to nodes in blocks, so that the first half of the threads
+/// share the first node and their split points stay local on two sockets.
+
+int NUMA::node_of(size_t idx, size_t threadCount) {
+
+  return int(idx * nodes() / threadCount);
+}
+
+
+/// NUMA::bind_thread() restricts a thread to the CPUs of a node. With a negative
+/// node the thread may run again on the CPUs we started with.
+
+void NUMA::bind_thread(NativeHandle handle, int node) {
+
+#ifdef USE_NUMA
+  cpu_set_t set = cpu_set(node);
+  pthread_setaffinity_np(handle, sizeof(set), &set);
+#else
+  (void)handle, (void)node;
+#endif
+}
+
+void NUMA::bind_this_thread(int node) {
+
+#ifdef USE_NUMA
+  bind_thread(pthread_self(), node);
+#else
+  (void)node;
+#endif
+}
+
+
+/// NUMA::bind_memory() moves the pages of a block of memory to a node
+
+void NUMA::bind_memory(void* mem, size_t size, int node) {
+
+#ifdef USE_NUMA
+  if (node >= 0 && node < int(NodeIds.size()))
+      mbind(mem, size, MPOL_BIND_, 1UL << NodeIds[node]);
+#else
+  (void)mem, (void)size, (void)node;
+#endif
+}
+
+
+/// NUMA::interleave_memory() spreads the pages of a block of memory round robin
+/// over all the nodes, so that a shared table is equally far from every thread.
+
+void NUMA::interleave_memory(void* mem, size_t size) {
+
+#ifdef USE_NUMA
+  unsigned long nodeMask = 0;
+
+  for (size_t i = 0; i < NodeIds.size(); ++i)
+      nodeMask |= 1UL << NodeIds[i];
+
+  if (NodeIds.size() > 1)
+      mbind(mem, size, MPOL_INTERLEAVE_, nodeMask);
+#else
+  (void)mem, (void)size;
+#endif
+}
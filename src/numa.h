@@ -0,0 +1,43 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NUMA_H_INCLUDED
+#define NUMA_H_INCLUDED
+
+#include <cstddef>
+
+#include "platform.h"
+
+/// The NUMA namespace places threads and memory on the nodes of a machine with
+/// several sockets. Nodes are read from sysfs, so everything is a no-op but on
+/// Linux native builds, and errors (like a kernel without NUMA) are ignored.
+
+namespace NUMA {
+
+void init();
+int nodes();
+int node_of(size_t idx, size_t threadCount);
+void bind_thread(NativeHandle handle, int node);
+void bind_this_thread(int node);
+void bind_memory(void* mem, size_t size, int node);
+void interleave_memory(void* mem, size_t size);
+
+}
+
+#endif // #ifndef NUMA_H_INCLUDED
@@ -22,6 +22,7 @@
 
 #include "bitboard.h"
 #include "bitcount.h"
+#include "engine.h"
 #include "pawns.h"
 #include "position.h"
 #include "thread.h"
@@ -225,17 +226,29 @@ void init()
 /// the pawns hash table. It returns a pointer to the Entry if the position
 /// is found. Otherwise a new Entry is computed and stored there, so we don't
 /// have to recompute all when the same pawns configuration occurs again.
+/// With a table shared by the threads, the Entry is a copy owned by the thread.
 
 Entry* probe(const Position& pos) {
 
   Key key = pos.pawn_key();
-  Entry* e = pos.this_thread()->pawnsTable[key];
+  Thread* thisThread = pos.this_thread();
+  SharedTable& shared = thisThread->engine->pawnsTable;
+  Entry* e = shared.enabled() ? &thisThread->pawnEntry : thisThread->pawnsTable[key];
 
-  if (e->key == key)
+  ++thisThread->pawnProbes;
+
+  if (shared.enabled() ? shared.probe(key, *e) : e->key == key)
+  {
+      ++thisThread->pawnHits;
       return e;
+  }
 
   e->key = key;
   e->score = evaluate<WHITE>(pos, e) - evaluate<BLACK>(pos, e);
+
+  if (shared.enabled())
+      shared.store(*e);
+
   return e;
 }
 
@@ -75,6 +75,7 @@ struct Entry {
 };
 
 typedef HashTable<Entry, 16384> Table;
+typedef SharedHashTable<Entry> SharedTable;
 
 void init();
 Entry* probe(const Position& pos);
@@ -42,6 +42,13 @@ typedef unsigned __int64 uint64_t;
 #  include <inttypes.h>
 #endif
 
+/// Stockfish.js is single threaded and searches in slices run from the event
+/// loop, unless it is built with pthreads (ARCH=js-threads). Then the threads
+/// are Web Workers sharing the heap and the engine works as the native one.
+#if defined(EMSCRIPTEN) && !defined(__EMSCRIPTEN_PTHREADS__)
+#  define NO_THREADS
+#endif
+
 #ifndef _WIN32 // Linux - Unix
 
 #  include <sys/time.h>
@@ -52,6 +59,34 @@ inline int64_t system_time_to_msec() {
   return t.tv_sec * 1000LL + t.tv_usec / 1000;
 }
 
+#  ifndef NO_THREADS // Native and js-threads builds use real POSIX threads
+
+#  include <pthread.h>
+
+typedef pthread_mutex_t Lock;
+typedef pthread_cond_t WaitCondition;
+typedef pthread_t NativeHandle;
+
+#  define lock_init(x) pthread_mutex_init(&(x), NULL)
+#  define lock_grab(x) pthread_mutex_lock(&(x))
+#  define lock_release(x) pthread_mutex_unlock(&(x))
+#  define lock_destroy(x) pthread_mutex_destroy(&(x))
+#  define cond_destroy(x) pthread_cond_destroy(&(x))
+#  define cond_init(x) pthread_cond_init(&(x), NULL)
+#  define cond_signal(x) pthread_cond_signal(&(x))
+#  define cond_wait(x,y) pthread_cond_wait(&(x),&(y))
+#  define cond_timedwait(x,y,z) pthread_cond_timedwait(&(x),&(y),z)
+#  define thread_create(x,f,t) pthread_create(&(x),NULL,f,t)
+#  define thread_join(x) pthread_join(x, NULL)
+// Atomic operations on 32 bit integers, all of them are full memory barriers
+#  define atomic_cas(x,o,n) __sync_bool_compare_and_swap(&(x), o, n)
+#  define atomic_or(x,v) __sync_fetch_and_or(&(x), v)
+#  define atomic_and(x,v) __sync_fetch_and_and(&(x), v)
+#  define atomic_add(x,v) __sync_add_and_fetch(&(x), v)
+#  define memory_barrier() __sync_synchronize()
+
+#  else // Stockfish.js is single threaded, so everything is a no-op
+
 typedef void* Lock;
 typedef void* WaitCondition;
 typedef void* NativeHandle;
@@ -68,6 +103,13 @@ typedef void*(*pt_start_fn)(void*);
 #  define cond_timedwait(x,y,z) ((void)x,(void)y,(void)z)
 #  define thread_create(x,f,t) (x = ((void)f,(void)t,(void*)0))
 #  define thread_join(x) ((void)x)
+#  define atomic_cas(x,o,n) ((x) == (o) ? ((x) = (n), true) : false)
+#  define atomic_or(x,v) ((x) |= (v))
+#  define atomic_and(x,v) ((x) &= (v))
+#  define atomic_add(x,v) ((x) += (v))
+#  define memory_barrier() ((void)0)
+
+#  endif
 
 #else // Windows and MinGW
 
@@ -109,6 +151,11 @@ inline DWORD* dwWin9xKludge() { static DWORD dw; return &dw; }
 #  define cond_timedwait(x,y,z) { lock_release(y); WaitForSingleObject(x,z); lock_grab(y); }
 #  define thread_create(x,f,t) (x = CreateThread(NULL,0,(LPTHREAD_START_ROUTINE)f,t,0,dwWin9xKludge()))
 #  define thread_join(x) { WaitForSingleObject(x, INFINITE); CloseHandle(x); }
+#  define atomic_cas(x,o,n) (InterlockedCompareExchange((volatile LONG*)&(x), n, o) == (o))
+#  define atomic_or(x,v) InterlockedOr((volatile LONG*)&(x), v)
+#  define atomic_and(x,v) InterlockedAnd((volatile LONG*)&(x), v)
+#  define atomic_add(x,v) (InterlockedExchangeAdd((volatile LONG*)&(x), v) + (v))
+#  define memory_barrier() MemoryBarrier()
 
 #endif
 
@@ -24,6 +24,7 @@
 #include <sstream>
 
 #include "bitcount.h"
+#include "engine.h"
 #include "misc.h"
 #include "movegen.h"
 #include "position.h"
@@ -86,22 +87,18 @@ PieceType min_attacker<KING>(const Bitboard*, const Square&, const Bitboard&, Bi
 } // namespace
 
 
-/// CheckInfo c'tor
+/// CheckInfo c'tor. The check info is already in StateInfo, computed once
+/// per position by set_check_info(), so here we just copy it.
 
 CheckInfo::CheckInfo(const Position& pos) {
 
-  Color them = ~pos.side_to_move();
-  ksq = pos.king_square(them);
+  ksq = pos.king_square(~pos.side_to_move());
 
   pinned = pos.pinned_pieces(pos.side_to_move());
   dcCandidates = pos.discovered_check_candidates();
 
-  checkSq[PAWN]   = pos.attacks_from<PAWN>(ksq, them);
-  checkSq[KNIGHT] = pos.attacks_from<KNIGHT>(ksq);
-  checkSq[BISHOP] = pos.attacks_from<BISHOP>(ksq);
-  checkSq[ROOK]   = pos.attacks_from<ROOK>(ksq);
-  checkSq[QUEEN]  = checkSq[BISHOP] | checkSq[ROOK];
-  checkSq[KING]   = 0;
+  for (PieceType pt = PAWN; pt <= KING; ++pt)
+      checkSq[pt] = pos.check_squares(pt);
 }
 
 
@@ -364,6 +361,26 @@ void Position::set_castling_right(Color c, Square rfrom) {
 }
 
 
+/// Position::set_check_info() sets king blockers and the squares from which
+/// each piece type would give check to the opponent king. They are computed
+/// once per position and then read by move generation, search and evaluation.
+
+void Position::set_check_info(StateInfo* si) const {
+
+  si->blockersForKing[WHITE] = slider_blockers(pieces(BLACK), king_square(WHITE));
+  si->blockersForKing[BLACK] = slider_blockers(pieces(WHITE), king_square(BLACK));
+
+  Square ksq = king_square(~sideToMove);
+
+  si->checkSquares[PAWN]   = attacks_from<PAWN>(ksq, ~sideToMove);
+  si->checkSquares[KNIGHT] = attacks_from<KNIGHT>(ksq);
+  si->checkSquares[BISHOP] = attacks_from<BISHOP>(ksq);
+  si->checkSquares[ROOK]   = attacks_from<ROOK>(ksq);
+  si->checkSquares[QUEEN]  = si->checkSquares[BISHOP] | si->checkSquares[ROOK];
+  si->checkSquares[KING]   = 0;
+}
+
+
 /// Position::set_state() computes the hash keys of the position, and other
 /// data that once computed is updated incrementally as moves are made.
 /// The function is only used when a new position is set up, and to verify
@@ -377,6 +394,8 @@ void Position::set_state(StateInfo* si) const {
 
   si->checkersBB = attackers_to(king_square(sideToMove)) & pieces(~sideToMove);
 
+  set_check_info(si);
+
   for (Bitboard b = pieces(); b; )
   {
       Square s = pop_lsb(&b);
@@ -473,28 +492,27 @@ Phase Position::game_phase() const {
 }
 
 
-/// Position::check_blockers() returns a bitboard of all the pieces with color
-/// 'c' that are blocking check on the king with color 'kingColor'. A piece
-/// blocks a check if removing that piece from the board would result in a
-/// position where the king is in check. A check blocking piece can be either a
-/// pinned or a discovered check piece, according if its color 'c' is the same
-/// or the opposite of 'kingColor'.
+/// Position::slider_blockers() returns a bitboard of all the pieces (of both
+/// colors) that are blocking attacks on the square 's' from 'sliders'. A piece
+/// blocks a slider if removing that piece from the board would result in a
+/// position where square 's' is attacked. For example, a king-attack blocking
+/// piece can be either a pinned or a discovered check piece, according if its
+/// color is the same or the opposite of the king.
 
-Bitboard Position::check_blockers(Color c, Color kingColor) const {
+Bitboard Position::slider_blockers(Bitboard sliders, Square s) const {
 
   Bitboard b, pinners, result = 0;
-  Square ksq = king_square(kingColor);
 
-  // Pinners are sliders that give check when a pinned piece is removed
-  pinners = (  (pieces(  ROOK, QUEEN) & PseudoAttacks[ROOK  ][ksq])
-             | (pieces(BISHOP, QUEEN) & PseudoAttacks[BISHOP][ksq])) & pieces(~kingColor);
+  // Pinners are sliders that attack 's' when a pinned piece is removed
+  pinners = (  (PseudoAttacks[ROOK  ][s] & pieces(QUEEN, ROOK))
+             | (PseudoAttacks[BISHOP][s] & pieces(QUEEN, BISHOP))) & sliders;
 
   while (pinners)
   {
-      b = between_bb(ksq, pop_lsb(&pinners)) & pieces();
+      b = between_bb(s, pop_lsb(&pinners)) & pieces();
 
       if (!more_than_one(b))
-          result |= b & pieces(c);
+          result |= b;
   }
   return result;
 }
@@ -703,10 +721,12 @@ void Position::do_move(Move m, StateInfo& newSt) {
   do_move(m, newSt, ci, gives_check(m, ci));
 }
 
-// TimerThread::idle_loop() is where the timer thread waits msec milliseconds
-// and then calls check_time(). If msec is 0 thread sleeps until is woken up.
-extern void check_time();
+#ifdef NO_THREADS
+/// Single threaded Stockfish.js has no timer thread, so the search itself
+/// calls check_time() every 32 moves. Native builds leave it to TimerThread.
+extern void check_time(Engine& e);
 static int check_time_counter = 0;
+#endif
 
 void Position::do_move(Move m, StateInfo& newSt, const CheckInfo& ci, bool moveIsCheck) {
 
@@ -714,8 +734,10 @@ void Position::do_move(Move m, StateInfo& newSt, const CheckInfo& ci, bool moveI
   assert(&newSt != st);
 
   ++nodes;
+#ifdef NO_THREADS
   if((++check_time_counter & 31) ==0)
-	  check_time();
+	  check_time(*thisThread->engine);
+#endif
   Key k = st->key;
 
   // Copy some fields of the old state to our new StateInfo object except the
@@ -788,10 +810,11 @@ void Position::do_move(Move m, StateInfo& newSt, const CheckInfo& ci, bool moveI
       // Update board and piece lists
       remove_piece(capsq, them, captured);
 
-      // Update material hash key and prefetch access to materialTable
+      // Update material hash key and prefetch access to the material table
       k ^= Zobrist::psq[them][captured][capsq];
       st->materialKey ^= Zobrist::psq[them][captured][pieceCount[them][captured]];
-      prefetch((char*)thisThread->materialTable[st->materialKey]);
+      prefetch(thisThread->engine->materialTable.enabled() ? thisThread->engine->materialTable.slot(st->materialKey)
+                                                           : (char*)thisThread->materialTable[st->materialKey]);
 
       // Update incremental scores
       st->psq -= psq[them][captured][capsq];
@@ -856,9 +879,10 @@ void Position::do_move(Move m, StateInfo& newSt, const CheckInfo& ci, bool moveI
           st->nonPawnMaterial[us] += PieceValue[MG][promotion];
       }
 
-      // Update pawn hash key and prefetch access to pawnsTable
+      // Update pawn hash key and prefetch access to the pawn table
       st->pawnKey ^= Zobrist::psq[us][PAWN][from] ^ Zobrist::psq[us][PAWN][to];
-      prefetch((char*)thisThread->pawnsTable[st->pawnKey]);
+      prefetch(thisThread->engine->pawnsTable.enabled() ? thisThread->engine->pawnsTable.slot(st->pawnKey)
+                                                        : (char*)thisThread->pawnsTable[st->pawnKey]);
 
       // Reset rule 50 draw counter
       st->rule50 = 0;
@@ -900,6 +924,8 @@ void Position::do_move(Move m, StateInfo& newSt, const CheckInfo& ci, bool moveI
 
   sideToMove = ~sideToMove;
 
+  set_check_info(st);
+
   assert(pos_is_ok());
 }
 
@@ -1005,13 +1031,15 @@ void Position::do_null_move(StateInfo& newSt) {
   }
 
   st->key ^= Zobrist::side;
-  prefetch((char*)TT.first_entry(st->key));
+  prefetch((char*)thisThread->engine->tt->first_entry(st->key));
 
   ++st->rule50;
   st->pliesFromNull = 0;
 
   sideToMove = ~sideToMove;
 
+  set_check_info(st);
+
   assert(pos_is_ok());
 }
 
@@ -1253,7 +1281,9 @@ bool Position::pos_is_ok(int* step) const {
           || st->nonPawnMaterial[WHITE] != si.nonPawnMaterial[WHITE]
           || st->nonPawnMaterial[BLACK] != si.nonPawnMaterial[BLACK]
           || st->psq != si.psq
-          || st->checkersBB != si.checkersBB)
+          || st->checkersBB != si.checkersBB
+          || st->blockersForKing[WHITE] != si.blockersForKing[WHITE]
+          || st->blockersForKing[BLACK] != si.blockersForKing[BLACK])
           return false;
   }
 
@@ -23,10 +23,12 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdlib>   // For std::calloc
 #include <cstring>   // For std::memset
 #include <iostream>
 #include <sstream>
 
+#include "engine.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "movegen.h"
@@ -39,13 +41,7 @@
 
 namespace Search {
 
-  volatile SignalsType Signals;
-  LimitsType Limits;
-  RootMoveVector RootMoves;
-  Position RootPos;
-  Time::point SearchTime;
-  StateStackPtr SetupStates;
-  void emscript_think_done();
+  void emscript_think_done(Engine& e);
   void emscript_finalize(void *arg);
 }
 
@@ -76,14 +72,11 @@ namespace {
     return (Depth) Reductions[PvNode][i][std::min(int(d), 63)][std::min(mn, 63)];
   }
 
-  size_t multiPV; /// Stockfish.js
-  size_t PVIdx;
-  TimeManager TimeMgr;
-  double BestMoveChanges;
-  Value DrawValue[COLOR_NB];
-  HistoryStats History;
-  GainsStats Gains;
-  MovesStats Countermoves, Followupmoves;
+  // Lazy SMP helpers skip some iterations so that the threads spread over
+  // different depths. Helper 'idx' searches 'depth' only when the quotient of
+  // (depth + game ply + SkipPhase) by SkipSize is even.
+  const int SkipSize[]  = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+  const int SkipPhase[] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
 
   template <NodeType NT, bool SpNode>
   Value search(Position& pos, Stack* ss, Value alpha, Value beta, Depth depth, bool cutNode);
@@ -91,29 +84,15 @@ namespace {
   template <NodeType NT, bool InCheck>
   Value qsearch(Position& pos, Stack* ss, Value alpha, Value beta, Depth depth);
 
-  void id_loop(Position& pos);
+  void id_loop(Engine& e);
   void async_loop(void *arg);  /// Stockfish.js
+  void helper_loop(Thread* th);
   Value value_to_tt(Value v, int ply);
   Value value_from_tt(Value v, int ply);
   void update_pv(Move* pv, Move move, Move* childPv);
   void update_stats(const Position& pos, Stack* ss, Move move, Depth depth, Move* quiets, int quietsCnt);
   string uci_pv(const Position& pos, Depth depth, Value alpha, Value beta);
 
-  struct Skill {
-    Skill(int l, size_t rootSize) : level(l),
-                                    candidates(l < 20 ? std::min(4, (int)rootSize) : 0),
-                                    best(MOVE_NONE) {}
-    ///NOTE: The deconstructor, ~Skill(), breaks stuff when compiled to JavaScript. This code was moved to async_loop().
-
-    size_t candidates_size() const { return candidates; }
-    bool time_to_pick(Depth depth) const { return depth / ONE_PLY == 1 + level; }
-    Move pick_move();
-
-    int level;
-    size_t candidates;
-    Move best;
-  };
-
 } // namespace
 
 
@@ -148,43 +127,219 @@ void Search::init() {
 }
 
 
+namespace {
+
+  // Perft hash entry. The key, mixed with the depth, is stored XORed with the
+  // node count, so that an entry torn by a concurrent write reads as a miss.
+  struct PerftEntry {
+    volatile uint64_t key, nodes;
+  };
+
+  // PerftJob is shared by the perft workers. A work item is a root move and,
+  // when deep enough, one of its replies. Items are handed out in order under
+  // the mutex and each worker writes the count of its items.
+  struct PerftJob {
+    const Position* root;
+    Depth depth;
+    PerftEntry* table;
+    size_t mask;
+    std::vector<Move> moves, replies;
+    std::vector<uint64_t> counts;
+    size_t next;
+    Mutex mutex;
+  };
+
+  // perft() counts the leaf nodes below 'pos'. Moves at the last ply are not
+  // made, the size of the legal move list is enough (bulk counting).
+  uint64_t perft(Position& pos, Depth depth, PerftJob& job) {
+
+    if (depth <= ONE_PLY)
+        return MoveList<LEGAL>(pos).size();
+
+    Key key = pos.key() ^ (Key(depth) * 0x9E3779B97F4A7C15ULL);
+    PerftEntry* tte = job.table ? &job.table[key & job.mask] : NULL;
+
+    if (tte)
+    {
+        uint64_t k = tte->key, nodes = tte->nodes;
+
+        if ((k ^ nodes) == key)
+            return nodes;
+    }
+
+    StateInfo st;
+    uint64_t nodes = 0;
+    CheckInfo ci(pos);
+
+    for (MoveList<LEGAL> it(pos); *it; ++it)
+    {
+        pos.do_move(*it, st, ci, pos.gives_check(*it, ci));
+        nodes += perft(pos, depth - ONE_PLY, job);
+        pos.undo_move(*it);
+    }
+
+    if (tte)
+    {
+        tte->key = key ^ nodes;
+        tte->nodes = nodes;
+    }
+
+    return nodes;
+  }
+
+  // perft_worker() is the C function launched for each perft thread. The
+  // calling thread runs it too.
+
+  extern "C" { void* perft_worker(void* arg) {
+
+    PerftJob* job = static_cast<PerftJob*>(arg);
+
+    StateInfo st[2];
+
+    while (true)
+    {
+        job->mutex.lock();
+        size_t i = job->next++;
+        job->mutex.unlock();
+
+        if (i >= job->moves.size())
+            break;
+
+        Position pos(*job->root, job->root->this_thread());
+        pos.do_move(job->moves[i], st[0]);
+
+        if (job->replies[i])
+        {
+            pos.do_move(job->replies[i], st[1]);
+            job->counts[i] = perft(pos, job->depth - 2 * ONE_PLY, *job);
+        }
+        else
+            job->counts[i] = perft(pos, job->depth - ONE_PLY, *job);
+    }
+
+    return NULL;
+  } }
+
+} // namespace
+
+
 /// Search::perft() is our utility to verify move generation. All the leaf nodes
-/// up to the given depth are generated and counted and the sum returned.
-template<bool Root>
+/// up to the given depth are counted and the sum returned, after printing the
+/// count below each root move (divide). The tree is split at the second ply
+/// among Options["Threads"] threads, and subtrees already counted are found in
+/// a perft hash of up to Options["Hash"] MB, sized from the depth and separate
+/// from the transposition table.
+
 uint64_t Search::perft(Position& pos, Depth depth) {
 
+  PerftJob job;
   StateInfo st;
-  uint64_t cnt, nodes = 0;
-  CheckInfo ci(pos);
-  const bool leaf = (depth == 2 * ONE_PLY);
+  std::vector<Move> rootMoves;
 
   for (MoveList<LEGAL> it(pos); *it; ++it)
   {
-      if (Root && depth <= ONE_PLY)
-          cnt = 1, nodes++;
-      else
+      rootMoves.push_back(*it);
+
+      if (depth <= ONE_PLY)
+          continue;
+
+      if (depth == 2 * ONE_PLY)
+      {
+          job.moves.push_back(*it);
+          job.replies.push_back(MOVE_NONE);
+          continue;
+      }
+
+      pos.do_move(*it, st);
+
+      for (MoveList<LEGAL> r(pos); *r; ++r)
       {
-          pos.do_move(*it, st, ci, pos.gives_check(*it, ci));
-          cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - ONE_PLY);
-          nodes += cnt;
-          pos.undo_move(*it);
+          job.moves.push_back(*it);
+          job.replies.push_back(*r);
       }
-      if (Root)
-          sync_cout << UCI::move(*it, pos.is_chess960()) << ": " << cnt << sync_endl;
+
+      pos.undo_move(*it);
+  }
+
+  // Positions are hashed from the third ply down to depth 2, that is about
+  // 32^(depth - 2) of them, so a small perft doesn't allocate the whole Hash.
+  int hashBits = std::min(5 * (depth / ONE_PLY - 2),
+                          int(msb((size_t(Options["Hash"]) * 1024 * 1024) / sizeof(PerftEntry))));
+  size_t entries = depth > 3 * ONE_PLY ? size_t(1) << hashBits : 0;
+
+  job.root = &pos;
+  job.depth = depth;
+  job.table = entries ? (PerftEntry*)std::calloc(entries, sizeof(PerftEntry)) : NULL; // May be NULL, run without hash
+  job.mask = entries - 1;
+  job.counts.resize(job.moves.size());
+  job.next = 0;
+
+#ifdef NO_THREADS
+  size_t threads = 1; // Helper threads never run in single threaded Stockfish.js
+#else
+  size_t threads = std::min(size_t(Options["Threads"]), std::max(job.moves.size(), size_t(1)));
+#endif
+  std::vector<NativeHandle> handles(threads - 1);
+
+  for (size_t i = 0; i < handles.size(); ++i)
+      thread_create(handles[i], perft_worker, &job);
+
+  perft_worker(&job);
+
+  for (size_t i = 0; i < handles.size(); ++i)
+      thread_join(handles[i]);
+
+  std::free(job.table);
+
+  uint64_t nodes = 0;
+
+  for (size_t i = 0, j = 0; i < rootMoves.size(); ++i)
+  {
+      uint64_t cnt = depth <= ONE_PLY ? 1 : 0;
+
+      for ( ; j < job.moves.size() && job.moves[j] == rootMoves[i]; ++j)
+          cnt += job.counts[j];
+
+      nodes += cnt;
+      sync_cout << UCI::move(rootMoves[i], pos.is_chess960()) << ": " << cnt << sync_endl;
   }
+
   return nodes;
 }
 
-template uint64_t Search::perft<true>(Position& pos, Depth depth);
+
+/// Search::quiescence() returns the quiescence search score of a position, from
+/// the point of view of the side to move, without going through think() and
+/// the threads. It runs in the calling thread with the transposition table,
+/// history and draw values of the engine of pos.this_thread().
+
+Value Search::quiescence(Position& pos) {
+
+  Stack stack[MAX_PLY+4], *ss = stack+2; // To allow referencing (ss-2) and (ss+2)
+  Move pv[MAX_PLY+1];
+
+  std::memset(ss-2, 0, 5 * sizeof(Stack));
+  ss->pv = pv;
+
+  return pos.checkers() ? qsearch<PV,  true>(pos, ss, -VALUE_INFINITE, VALUE_INFINITE, DEPTH_ZERO)
+                        : qsearch<PV, false>(pos, ss, -VALUE_INFINITE, VALUE_INFINITE, DEPTH_ZERO);
+}
 
 
 /// Search::think() is the external interface to Stockfish's search, and is
 /// called by the main thread when the program receives the UCI 'go' command. It
-/// searches from RootPos and at the end prints the "bestmove" to output.
+/// searches from the engine root position and at the end prints the "bestmove"
+/// to output.
+
+void Search::think(Engine& e) {
 
-void Search::think() {
+  ThreadPool& Threads = e.threads;
+  Position& RootPos = e.rootPos;
+  RootMoveVector& RootMoves = e.rootMoves;
+  TimeManager& TimeMgr = e.timeMgr;
+  Value* DrawValue = e.drawValue;
 
-  TimeMgr.init(Limits, RootPos.side_to_move(), RootPos.game_ply());
+  TimeMgr.init(e.limits, RootPos.side_to_move(), RootPos.game_ply());
 
   int contempt = Options["Contempt"] * PawnValueEg / 100; // From centipawns
   DrawValue[ RootPos.side_to_move()] = VALUE_DRAW - Value(contempt);
@@ -193,32 +348,48 @@ void Search::think() {
   if (RootMoves.empty())
   {
       RootMoves.push_back(MOVE_NONE);
-      sync_cout << "info depth 0 score "
-                << UCI::value(RootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
-                << sync_endl;
 
-      Search::emscript_finalize(NULL);
+      if (!e.silent)
+          sync_cout << "info depth 0 score "
+                    << UCI::value(RootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
+                    << sync_endl;
+
+      Search::emscript_finalize(&e);
   }
   else
   {
     for (size_t i = 0; i < Threads.size(); ++i)
+    {
         Threads[i]->maxPly = 0;
+        Threads[i]->completedDepth = DEPTH_ZERO;
+        Threads[i]->splitNodes = 0;
+    }
     
     Threads.timer->run = true;
     Threads.timer->notify_one(); // Wake up the recurring timer
     
-    id_loop(RootPos); // Let's start searching !
+    id_loop(e); // Let's start searching !
   }
 }
 /// Async code
-void Search::emscript_think_done() {
-  Threads.timer->run = false; // Stop the timer
-  Search::emscript_finalize(NULL);
+void Search::emscript_think_done(Engine& e) {
+  e.threads.timer->run = false; // Stop the timer
+  Search::emscript_finalize(&e);
 }
 void Search::emscript_finalize(void *arg) {
+  /// Bind the engine state to the names used upstream
+  Engine& e = *(Engine*)arg;
+  ThreadPool& Threads = e.threads;
+  volatile SignalsType& Signals = e.signals;
+  LimitsType& Limits = e.limits;
+  RootMoveVector& RootMoves = e.rootMoves;
+  Position& RootPos = e.rootPos;
+  Time::point SearchTime = e.searchTime;
+
   // When search is stopped this info is not printed
-  sync_cout << "info nodes " << RootPos.nodes_searched()
-            << " time " << Time::now() - SearchTime + 1 << sync_endl;
+  if (!e.silent)
+      sync_cout << "info nodes " << Threads.nodes_searched()
+                << " time " << Time::now() - SearchTime + 1 << sync_endl;
 
   // When we reach the maximum depth, we can arrive here without a raise of
   // Signals.stop. However, if we are pondering or in an infinite search,
@@ -228,17 +399,55 @@ void Search::emscript_finalize(void *arg) {
   if (!Signals.stop && (Limits.ponder || Limits.infinite))
   {
       Signals.stopOnPonderhit = true;
-      #ifdef EMSCRIPTEN
-      emscripten_async_call(Search::emscript_finalize, NULL, 30); /// Loop while waiting for "stop" signal.
+      #ifdef NO_THREADS
+      emscripten_async_call(Search::emscript_finalize, arg, 30); /// Loop while waiting for "stop" signal.
       return;
       #else
       RootPos.this_thread()->wait_for(Signals.stop);
       #endif
   }
 
+  // In Lazy SMP mode stop the helpers, then play the move of the thread that
+  // has completed the deepest iteration, as long as it also scores better.
+  if (Threads.lazySMP)
+  {
+      Signals.stop = true;
+
+      Thread* bestThread = Threads.main();
+      RootMove* best = &RootMoves[0];
+
+      for (size_t i = 1; i < Threads.size(); ++i)
+      {
+          Thread* th = Threads[i];
+          th->wait_while(th->searching);
+
+          if (   e.multiPV == 1
+              && best->pv[0] != MOVE_NONE
+              && th->completedDepth > bestThread->completedDepth
+              && th->rootMoves[0].score > best->score)
+          {
+              bestThread = th;
+              best = &th->rootMoves[0];
+          }
+      }
+
+      if (bestThread != Threads.main())
+      {
+          RootMove& rm = *std::find(RootMoves.begin(), RootMoves.end(), best->pv[0]);
+          rm = *best;
+          std::swap(RootMoves[0], rm);
+
+          if (!e.silent)
+              sync_cout << uci_pv(RootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
+      }
+  }
+
+  if (e.silent)
+      return;
+
   sync_cout << "bestmove " << UCI::move(RootMoves[0].pv[0], RootPos.is_chess960());
 
-  if (RootMoves[0].pv.size() > 1 || RootMoves[0].extract_ponder_from_tt(RootPos))
+  if (RootMoves[0].pv.size() > 1 || RootMoves[0].extract_ponder(RootPos))
       std::cout << " ponder " << UCI::move(RootMoves[0].pv[1], RootPos.is_chess960());
 
   std::cout << sync_endl;
@@ -246,86 +455,107 @@ void Search::emscript_finalize(void *arg) {
 
 
 namespace {
-/// Declare variables out here so that they are reachable by async_loop()
-Depth depth_ref;
-Value bestValue_ref, alpha_ref, beta_ref, delta_ref;
-Position pos_ref;
-Stack *ss_ref;
-Stack stack[MAX_PLY+4];
-Skill *skill_p;
   // id_loop() is the main iterative deepening loop. It calls search() repeatedly
   // with increasing depth until the allocated thinking time has been consumed,
   // user stops the search, or the maximum search depth is reached.
 
-  void id_loop(Position& pos) {
+  void id_loop(Engine& e) {
+
+    ThreadPool& Threads = e.threads;
+    Position& pos = e.rootPos;
+    RootMoveVector& RootMoves = e.rootMoves;
 
     ///NOTE: The stack was moved out to prevent garbage collection.
-    ///      See Stack stack[MAX_PLY+4]; above.
+    ///      See Engine::stack.
   //Stack stack[MAX_PLY+4], *ss = stack+2; // To allow referencing (ss-2) and (ss+2)
-    Stack *ss = stack+2; // To allow referencing (ss-2)
+    Stack *ss = e.stack+2; // To allow referencing (ss-2)
     Depth depth;
     Value bestValue, alpha, beta, delta;
 
     std::memset(ss-2, 0, 5 * sizeof(Stack));
 
     depth = DEPTH_ZERO;
-    BestMoveChanges = 0;
+    e.bestMoveChanges = 0;
     bestValue = delta = alpha = -VALUE_INFINITE;
     beta = VALUE_INFINITE;
 
-    TT.new_search();
-    History.clear();
-    Gains.clear();
-    Countermoves.clear();
-    Followupmoves.clear();
+    if (e.owns_tt()) // A shared table is aged once by its owner, see batch()
+        e.tt->new_search();
+
+    e.history.clear();
+    e.gains.clear();
+    e.countermoves.clear();
+    e.followupmoves.clear();
+    e.pvTable.clear();
 
-    multiPV = Options["MultiPV"];
+    // In Lazy SMP mode all the other threads run their own iterative deepening
+    // loop, sharing only the transposition table (and the history tables).
+    if (Threads.lazySMP)
+        for (size_t i = 1; i < Threads.size(); ++i)
+        {
+            Threads[i]->rootPos = Position(pos, Threads[i]);
+            Threads[i]->rootMoves = RootMoves;
+            Threads[i]->activeSplitPoint = NULL;
+            Threads[i]->searching = true;
+            Threads[i]->notify_one();
+        }
+
+    e.multiPV = Options["MultiPV"];
     //Skill skill(Options["Skill Level"], RootMoves.size());
-    skill_p = new Skill(Options["Skill Level"], RootMoves.size());
+    e.skill = Skill(Options["Skill Level"], RootMoves.size());
 
     // Do we have to play with skill handicap? In this case enable MultiPV search
     // that we will use behind the scenes to retrieve a set of possible moves.
-    multiPV = std::max(multiPV, skill_p->candidates_size());
+    e.multiPV = std::max(e.multiPV, e.skill.candidates_size());
 
     /// This stuff was moved to async_loop().
     // Iterative deepening loop until requested to stop or target depth reached
     //while (++depth <= DEPTH_MAX && !Signals.stop && (!Limits.depth || depth <= Limits.depth)) /// Old sync code. The "if" statement in async_loop() must match it
-    /// Define variables so that async_loop() can read them.
-    depth_ref = depth;
-    bestValue_ref = bestValue;
-    alpha_ref = alpha;
-    beta_ref = beta;
-    delta_ref = delta;
-    pos_ref = pos;
-    ss_ref = ss;
-    async_loop(NULL);
+    /// Store variables in the engine so that async_loop() can read them.
+    e.depth = depth;
+    e.bestValue = bestValue;
+    e.alpha = alpha;
+    e.beta = beta;
+    e.delta = delta;
+    e.ss = ss;
+    async_loop(&e);
   }
   void async_loop(void *arg) {
-        /// Load variables from the outer scope so that we don't need to rename stuff inside the loop to make it easier to merge changes from upstream.
-        Depth depth = depth_ref;
-        Value bestValue = bestValue_ref;
-        Value alpha = alpha_ref;
-        Value beta = beta_ref;
-        Value delta = delta_ref;
-        Position pos = pos_ref;
-        Stack *ss = ss_ref;
-        Skill skill = *skill_p;
+        /// Load variables from the engine so that we don't need to rename stuff inside the loop to make it easier to merge changes from upstream.
+        Engine& e = *(Engine*)arg;
+        Depth depth = e.depth;
+        Value bestValue = e.bestValue;
+        Value alpha = e.alpha;
+        Value beta = e.beta;
+        Value delta = e.delta;
+        Position& pos = e.rootPos;
+        Stack *ss = e.ss;
+        Skill skill = e.skill;
+        ThreadPool& Threads = e.threads;
+        volatile SignalsType& Signals = e.signals;
+        LimitsType& Limits = e.limits;
+        RootMoveVector& RootMoves = e.rootMoves;
+        Time::point SearchTime = e.searchTime;
+        TimeManager& TimeMgr = e.timeMgr;
+        size_t& multiPV = e.multiPV;
+        size_t& PVIdx = e.pvIdx;
+        double& BestMoveChanges = e.bestMoveChanges;
         /// This must match the while loop from upstream.
         if(!(++depth < DEPTH_MAX && !Signals.stop && (!Limits.depth || depth <= Limits.depth))) {
             ///NOTE: This code used to be in the deconstructor of skill, but that caused heap errors and memory unalignment.
             if (skill.candidates) {
                 if (!skill.best) {
-                    skill.best = skill.pick_move();
+                    skill.best = skill.pick_move(RootMoves);
                 }
                 /// If it can't find another move, there's no need to change anything.
                 ///NOTE: Swapping when skill.best == 0 sometimes throws.
                 ///NOTE: This could be skill.candidates.
                 if (skill.best) { // Swap best PV line with the sub-optimal one
                     std::swap(RootMoves[0], *std::find(RootMoves.begin(),
-                                RootMoves.end(), skill.best ? skill.best : skill.pick_move()));
+                                RootMoves.end(), skill.best ? skill.best : skill.pick_move(RootMoves)));
                 }
             }
-            Search::emscript_think_done();
+            Search::emscript_think_done(e);
             return;
         }
         /// *
@@ -365,20 +595,16 @@ Skill *skill_p;
                 // search the already searched PV lines are preserved.
                 std::stable_sort(RootMoves.begin() + PVIdx, RootMoves.end());
 
-                // Write PV back to transposition table in case the relevant
-                // entries have been overwritten during the search.
-                for (size_t i = 0; i <= PVIdx; ++i)
-                    RootMoves[i].insert_pv_in_tt(pos);
-
-                // If search has been stopped break immediately. Sorting and
-                // writing PV back to TT is safe because RootMoves is still
-                // valid, although it refers to previous iteration.
+                // If search has been stopped break immediately. Sorting is
+                // safe because RootMoves is still valid, although it refers
+                // to previous iteration.
                 if (Signals.stop)
                     break;
 
                 // When failing high/low give some update (without cluttering
                 // the UI) before a re-search.
                 if (   multiPV == 1
+                    && !e.silent
                     && (bestValue <= alpha || bestValue >= beta)
                     && Time::now() - SearchTime > 3000)
                     sync_cout << uci_pv(pos, depth, alpha, beta) << sync_endl;
@@ -409,8 +635,11 @@ Skill *skill_p;
             // Sort the PV lines searched so far and update the GUI
             std::stable_sort(RootMoves.begin(), RootMoves.begin() + PVIdx + 1);
 
+            if (e.silent)
+                continue;
+
             if (Signals.stop)
-                sync_cout << "info nodes " << RootPos.nodes_searched()
+                sync_cout << "info nodes " << Threads.nodes_searched()
                           << " time " << Time::now() - SearchTime << sync_endl;
 
             else if (   PVIdx + 1 == std::min(multiPV, RootMoves.size())
@@ -418,9 +647,12 @@ Skill *skill_p;
                 sync_cout << uci_pv(pos, depth, alpha, beta) << sync_endl;
         }
 
+        if (!Signals.stop)
+            pos.this_thread()->completedDepth = depth;
+
         // If skill levels are enabled and time is up, pick a sub-optimal best move
         if (skill.candidates_size() && skill.time_to_pick(depth))
-            skill.pick_move();
+            skill.pick_move(RootMoves);
 
         // Have we found a "mate in x"?
         if (   Limits.mate
@@ -451,21 +683,84 @@ Skill *skill_p;
         /// *
         /// * End of upstream code.
         /// *
-        /// Set the outer variables now so that we can read them again (with new values) the next time we loop.
-        depth_ref = depth;
-        bestValue_ref = bestValue;
-        alpha_ref = alpha;
-        beta_ref = beta;
-        delta_ref = delta;
-        pos_ref = pos;
-        ss_ref = ss;
-        #ifdef EMSCRIPTEN
-        emscripten_async_call(async_loop, NULL, 1); /// loop
+        /// Store the variables now so that we can read them again (with new values) the next time we loop.
+        e.depth = depth;
+        e.bestValue = bestValue;
+        e.alpha = alpha;
+        e.beta = beta;
+        e.delta = delta;
+        e.ss = ss;
+        #ifdef NO_THREADS
+        emscripten_async_call(async_loop, arg, 1); /// loop
         #else
-        async_loop(NULL);
+        async_loop(arg);
         #endif
   }
 
+
+  // helper_loop() is the iterative deepening loop of a Lazy SMP helper thread.
+  // It is a single PV id_loop() without time management and output: the helper
+  // searches its copy of the root position and moves, set up by id_loop(), until
+  // the main thread raises Signals.stop.
+
+  void helper_loop(Thread* th) {
+
+    Stack helperStack[MAX_PLY+4], *ss = helperStack+2; // To allow referencing (ss-2) and (ss+2)
+    Value bestValue, alpha, beta, delta;
+    int i = (th->idx - 1) % 20;
+    volatile SignalsType& Signals = th->engine->signals;
+    const LimitsType& Limits = th->engine->limits;
+
+    std::memset(ss-2, 0, 5 * sizeof(Stack));
+
+    bestValue = delta = alpha = -VALUE_INFINITE;
+    beta = VALUE_INFINITE;
+
+    for (Depth depth = ONE_PLY; depth < DEPTH_MAX && !Signals.stop && (!Limits.depth || depth <= Limits.depth); ++depth)
+    {
+        if (((depth + th->rootPos.game_ply() + SkipPhase[i]) / SkipSize[i]) % 2)
+            continue;
+
+        for (size_t j = 0; j < th->rootMoves.size(); ++j)
+            th->rootMoves[j].previousScore = th->rootMoves[j].score;
+
+        if (depth >= 5 * ONE_PLY)
+        {
+            delta = Value(16);
+            alpha = std::max(th->rootMoves[0].previousScore - delta,-VALUE_INFINITE);
+            beta  = std::min(th->rootMoves[0].previousScore + delta, VALUE_INFINITE);
+        }
+
+        while (true)
+        {
+            bestValue = search<Root, false>(th->rootPos, ss, alpha, beta, depth, false);
+
+            std::stable_sort(th->rootMoves.begin(), th->rootMoves.end());
+
+            if (Signals.stop)
+                break;
+
+            if (bestValue <= alpha)
+            {
+                beta = (alpha + beta) / 2;
+                alpha = std::max(bestValue - delta, -VALUE_INFINITE);
+            }
+            else if (bestValue >= beta)
+            {
+                alpha = (alpha + beta) / 2;
+                beta = std::min(bestValue + delta, VALUE_INFINITE);
+            }
+            else
+                break;
+
+            delta += delta / 2;
+        }
+
+        if (!Signals.stop)
+            th->completedDepth = depth;
+    }
+  }
+
   // search<>() is the main search function for both PV and non-PV nodes and for
   // normal and SplitPoint nodes. When called just after a split point the search
   // is simpler because we have already probed the hash table, done a null move
@@ -485,7 +780,7 @@ Skill *skill_p;
 
     Move pv[MAX_PLY+1], quietsSearched[64];
     StateInfo st;
-    TTEntry* tte;
+    TTEntry tte;
     SplitPoint* splitPoint;
     Key posKey;
     Move ttMove, move, excludedMove, bestMove;
@@ -499,12 +794,26 @@ Skill *skill_p;
     Thread* thisThread = pos.this_thread();
     inCheck = pos.checkers();
 
+    Engine& e = *thisThread->engine;
+    ThreadPool& Threads = e.threads;
+    TranspositionTable& TT = *e.tt;
+    volatile SignalsType& Signals = e.signals;
+    const Value* DrawValue = e.drawValue;
+    HistoryStats& History = e.history;
+    GainsStats& Gains = e.gains;
+    MovesStats& Countermoves = e.countermoves;
+    MovesStats& Followupmoves = e.followupmoves;
+
+    // At the root Lazy SMP helpers search a single PV on their own root moves
+    const bool helper = RootNode && !SpNode && thisThread != Threads.main();
+    RootMoveVector& rootMoves = helper ? thisThread->rootMoves : e.rootMoves;
+    const size_t pvIdx = helper ? 0 : e.pvIdx;
+
     if (SpNode)
     {
         splitPoint = ss->splitPoint;
         bestMove   = splitPoint->bestMove;
         bestValue  = splitPoint->bestValue;
-        tte = NULL;
         ttHit = false;
         ttMove = excludedMove = MOVE_NONE;
         ttValue = VALUE_NONE;
@@ -552,16 +861,18 @@ Skill *skill_p;
     excludedMove = ss->excludedMove;
     posKey = excludedMove ? pos.exclusion_key() : pos.key();
     tte = TT.probe(posKey, ttHit);
-    ss->ttMove = ttMove = RootNode ? RootMoves[PVIdx].pv[0] : ttHit ? tte->move() : MOVE_NONE;
-    ttValue = ttHit ? value_from_tt(tte->value(), ss->ply) : VALUE_NONE;
+    ss->ttMove = ttMove =  RootNode ? rootMoves[pvIdx].pv[0]
+                         : ttHit && tte.move() ? tte.move()
+                         : PvNode ? e.pvTable.probe(posKey) : MOVE_NONE; // Lost PV move
+    ttValue = ttHit ? value_from_tt(tte.value(), ss->ply) : VALUE_NONE;
 
     // At non-PV nodes we check for a fail high/low. We don't probe at PV nodes
     if (  !PvNode
         && ttHit
-        && tte->depth() >= depth
+        && tte.depth() >= depth
         && ttValue != VALUE_NONE // Only in case of TT access race
-        && (ttValue >= beta ? (tte->bound() & BOUND_LOWER)
-                            : (tte->bound() & BOUND_UPPER)))
+        && (ttValue >= beta ? (tte.bound() & BOUND_LOWER)
+                            : (tte.bound() & BOUND_UPPER)))
     {
         ss->currentMove = ttMove; // Can be MOVE_NONE
 
@@ -582,12 +893,12 @@ Skill *skill_p;
     else if (ttHit)
     {
         // Never assume anything on values stored in TT
-        if ((ss->staticEval = eval = tte->eval()) == VALUE_NONE)
+        if ((ss->staticEval = eval = tte.eval()) == VALUE_NONE)
             eval = ss->staticEval = evaluate(pos);
 
         // Can ttValue be used as a better position evaluation?
         if (ttValue != VALUE_NONE)
-            if (tte->bound() & (ttValue > eval ? BOUND_LOWER : BOUND_UPPER))
+            if (tte.bound() & (ttValue > eval ? BOUND_LOWER : BOUND_UPPER))
                 eval = ttValue;
     }
     else
@@ -595,7 +906,7 @@ Skill *skill_p;
         eval = ss->staticEval =
         (ss-1)->currentMove != MOVE_NULL ? evaluate(pos) : -(ss-1)->staticEval + 2 * Eval::Tempo;
 
-        tte->save(posKey, VALUE_NONE, BOUND_NONE, DEPTH_NONE, MOVE_NONE, ss->staticEval, TT.generation());
+        tte.save(posKey, VALUE_NONE, BOUND_NONE, DEPTH_NONE, MOVE_NONE, ss->staticEval, TT.generation());
     }
 
     if (ss->skipEarlyPruning)
@@ -718,7 +1029,7 @@ Skill *skill_p;
         ss->skipEarlyPruning = false;
 
         tte = TT.probe(posKey, ttHit);
-        ttMove = ttHit ? tte->move() : MOVE_NONE;
+        ttMove = ttHit ? tte.move() : MOVE_NONE;
     }
 
 moves_loop: // When in check and at SpNode search starts from here
@@ -745,8 +1056,8 @@ moves_loop: // When in check and at SpNode search starts from here
                        /*  &&  ttValue != VALUE_NONE Already implicit in the next condition */
                            &&  abs(ttValue) < VALUE_KNOWN_WIN
                            && !excludedMove // Recursive singular search is not allowed
-                           && (tte->bound() & BOUND_LOWER)
-                           &&  tte->depth() >= depth - 3 * ONE_PLY;
+                           && (tte.bound() & BOUND_LOWER)
+                           &&  tte.depth() >= depth - 3 * ONE_PLY;
 
     // Step 11. Loop through moves
     // Loop through all pseudo-legal moves until no moves remain or a beta cutoff occurs
@@ -760,7 +1071,7 @@ moves_loop: // When in check and at SpNode search starts from here
       // At root obey the "searchmoves" option and skip moves not listed in Root
       // Move List. As a consequence any illegal move is also skipped. In MultiPV
       // mode we also skip PV moves which have been already searched.
-      if (RootNode && !std::count(RootMoves.begin() + PVIdx, RootMoves.end(), move))
+      if (RootNode && !std::count(rootMoves.begin() + pvIdx, rootMoves.end(), move))
           continue;
 
       if (SpNode)
@@ -769,7 +1080,7 @@ moves_loop: // When in check and at SpNode search starts from here
           if (!pos.legal(move, ci.pinned))
               continue;
 
-          moveCount = ++splitPoint->moveCount;
+          moveCount = atomic_add(splitPoint->moveCount, 1);
           splitPoint->mutex.unlock();
       }
       else
@@ -777,12 +1088,13 @@ moves_loop: // When in check and at SpNode search starts from here
 
       if (RootNode)
       {
-          Signals.firstRootMove = (moveCount == 1);
+          if (!helper)
+              Signals.firstRootMove = (moveCount == 1);
 
-          if (thisThread == Threads.main() && Time::now() - SearchTime > 3000)
+          if (thisThread == Threads.main() && !e.silent && Time::now() - e.searchTime > 3000)
               sync_cout << "info depth " << depth / ONE_PLY
                         << " currmove " << UCI::move(move, pos.is_chess960())
-                        << " currmovenumber " << moveCount + PVIdx << sync_endl;
+                        << " currmovenumber " << moveCount + e.pvIdx << sync_endl;
       }
 
       if (PvNode)
@@ -983,7 +1295,7 @@ moves_loop: // When in check and at SpNode search starts from here
 
       if (RootNode)
       {
-          RootMove& rm = *std::find(RootMoves.begin(), RootMoves.end(), move);
+          RootMove& rm = *std::find(rootMoves.begin(), rootMoves.end(), move);
 
           // PV move or new best move ?
           if (moveCount == 1 || value > alpha)
@@ -999,8 +1311,8 @@ moves_loop: // When in check and at SpNode search starts from here
               // We record how often the best move has been changed in each
               // iteration. This information is used for time management: When
               // the best move changes frequently, we allocate some more time.
-              if (moveCount > 1)
-                  ++BestMoveChanges;
+              if (moveCount > 1 && !helper)
+                  ++e.bestMoveChanges;
           }
           else
               // All other moves but the PV are set to the lowest value: this is
@@ -1018,7 +1330,10 @@ moves_loop: // When in check and at SpNode search starts from here
               bestMove = SpNode ? splitPoint->bestMove = move : move;
 
               if (PvNode && !RootNode) // Update pv even in fail-high case
+              {
                   update_pv(SpNode ? splitPoint->ss->pv : ss->pv, move, (ss+1)->pv);
+                  e.pvTable.save(pos.key(), move);
+              }
 
               if (PvNode && value < beta) // Update alpha! Always alpha < beta
                   alpha = SpNode ? splitPoint->alpha = value : value;
@@ -1037,6 +1352,7 @@ moves_loop: // When in check and at SpNode search starts from here
       // Step 19. Check for splitting the search
       if (   !SpNode
           &&  Threads.size() >= 2
+          && !Threads.lazySMP
           &&  depth >= Threads.minimumSplitDepth
           &&  (   !thisThread->activeSplitPoint
                || !thisThread->activeSplitPoint->allSlavesSearching)
@@ -1078,7 +1394,7 @@ moves_loop: // When in check and at SpNode search starts from here
     else if (bestValue >= beta && !pos.capture_or_promotion(bestMove) && !inCheck)
         update_stats(pos, ss, bestMove, depth, quietsSearched, quietCount - 1);
 
-    tte->save(posKey, value_to_tt(bestValue, ss->ply),
+    tte.save(posKey, value_to_tt(bestValue, ss->ply),
               bestValue >= beta ? BOUND_LOWER :
               PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER,
               depth, bestMove, ss->staticEval, TT.generation());
@@ -1106,13 +1422,18 @@ moves_loop: // When in check and at SpNode search starts from here
 
     Move pv[MAX_PLY+1];
     StateInfo st;
-    TTEntry* tte;
+    TTEntry tte;
     Key posKey;
     Move ttMove, move, bestMove;
     Value bestValue, value, ttValue, futilityValue, futilityBase, oldAlpha;
     bool ttHit, givesCheck, evasionPrunable;
     Depth ttDepth;
 
+    Engine& e = *pos.this_thread()->engine;
+    TranspositionTable& TT = *e.tt;
+    const Value* DrawValue = e.drawValue;
+    HistoryStats& History = e.history;
+
     if (PvNode)
     {
         oldAlpha = alpha; // To flag BOUND_EXACT when eval above alpha and no available moves
@@ -1138,15 +1459,15 @@ moves_loop: // When in check and at SpNode search starts from here
     // Transposition table lookup
     posKey = pos.key();
     tte = TT.probe(posKey, ttHit);
-    ttMove = ttHit ? tte->move() : MOVE_NONE;
-    ttValue = ttHit ? value_from_tt(tte->value(), ss->ply) : VALUE_NONE;
+    ttMove = ttHit ? tte.move() : MOVE_NONE;
+    ttValue = ttHit ? value_from_tt(tte.value(), ss->ply) : VALUE_NONE;
 
     if (  !PvNode
         && ttHit
-        && tte->depth() >= ttDepth
+        && tte.depth() >= ttDepth
         && ttValue != VALUE_NONE // Only in case of TT access race
-        && (ttValue >= beta ? (tte->bound() &  BOUND_LOWER)
-                            : (tte->bound() &  BOUND_UPPER)))
+        && (ttValue >= beta ? (tte.bound() &  BOUND_LOWER)
+                            : (tte.bound() &  BOUND_UPPER)))
     {
         ss->currentMove = ttMove; // Can be MOVE_NONE
         return ttValue;
@@ -1160,26 +1481,33 @@ moves_loop: // When in check and at SpNode search starts from here
     }
     else
     {
+        // A lazy evaluation is only good for this window, so it is not stored
+        // in the TT, where search() would take it as the static eval.
+        bool lazy = false;
+
         if (ttHit)
         {
             // Never assume anything on values stored in TT
-            if ((ss->staticEval = bestValue = tte->eval()) == VALUE_NONE)
-                ss->staticEval = bestValue = evaluate(pos);
+            if ((ss->staticEval = bestValue = tte.eval()) == VALUE_NONE)
+                ss->staticEval = bestValue = evaluate(pos, alpha, beta, &lazy);
 
             // Can ttValue be used as a better position evaluation?
             if (ttValue != VALUE_NONE)
-                if (tte->bound() & (ttValue > bestValue ? BOUND_LOWER : BOUND_UPPER))
+                if (tte.bound() & (ttValue > bestValue ? BOUND_LOWER : BOUND_UPPER))
                     bestValue = ttValue;
         }
         else
             ss->staticEval = bestValue =
-            (ss-1)->currentMove != MOVE_NULL ? evaluate(pos) : -(ss-1)->staticEval + 2 * Eval::Tempo;
+            (ss-1)->currentMove != MOVE_NULL ? evaluate(pos, alpha, beta, &lazy) : -(ss-1)->staticEval + 2 * Eval::Tempo;
+
+        if (lazy)
+            ss->staticEval = VALUE_NONE;
 
         // Stand pat. Return immediately if static value is at least beta
         if (bestValue >= beta)
         {
             if (!ttHit)
-                tte->save(pos.key(), value_to_tt(bestValue, ss->ply), BOUND_LOWER,
+                tte.save(pos.key(), value_to_tt(bestValue, ss->ply), BOUND_LOWER,
                           DEPTH_NONE, MOVE_NONE, ss->staticEval, TT.generation());
 
             return bestValue;
@@ -1276,7 +1604,7 @@ moves_loop: // When in check and at SpNode search starts from here
               }
               else // Fail high
               {
-                  tte->save(posKey, value_to_tt(value, ss->ply), BOUND_LOWER,
+                  tte.save(posKey, value_to_tt(value, ss->ply), BOUND_LOWER,
                             ttDepth, move, ss->staticEval, TT.generation());
 
                   return value;
@@ -1290,7 +1618,7 @@ moves_loop: // When in check and at SpNode search starts from here
     if (InCheck && bestValue == -VALUE_INFINITE)
         return mated_in(ss->ply); // Plies to mate from the root
 
-    tte->save(posKey, value_to_tt(bestValue, ss->ply),
+    tte.save(posKey, value_to_tt(bestValue, ss->ply),
               PvNode && bestValue > oldAlpha ? BOUND_EXACT : BOUND_UPPER,
               ttDepth, bestMove, ss->staticEval, TT.generation());
 
@@ -1339,6 +1667,11 @@ moves_loop: // When in check and at SpNode search starts from here
 
   void update_stats(const Position& pos, Stack* ss, Move move, Depth depth, Move* quiets, int quietsCnt) {
 
+    Engine& e = *pos.this_thread()->engine;
+    HistoryStats& History = e.history;
+    MovesStats& Countermoves = e.countermoves;
+    MovesStats& Followupmoves = e.followupmoves;
+
     if (ss->killers[0] != move)
     {
         ss->killers[1] = ss->killers[0];
@@ -1369,44 +1702,6 @@ moves_loop: // When in check and at SpNode search starts from here
   }
 
 
-  // When playing with a strength handicap, choose best move among the first 'candidates'
-  // RootMoves using a statistical rule dependent on 'level'. Idea by Heinz van Saanen.
-
-  Move Skill::pick_move() {
-
-    // PRNG sequence should be non-deterministic, so we seed it with the time at init
-    static PRNG rng(Time::now());
-
-    // RootMoves are already sorted by score in descending order
-    int variance = std::min(RootMoves[0].score - RootMoves[candidates - 1].score, PawnValueMg);
-    int weakness = 120 - 2 * level;
-    int maxScore = -VALUE_INFINITE;
-    best = MOVE_NONE;
-
-    // Choose best move. For each move score we add two terms both dependent on
-    // weakness. One deterministic and bigger for weaker moves, and one random,
-    // then we choose the move with the resulting highest score.
-    for (size_t i = 0; i < candidates; ++i)
-    {
-        int score = RootMoves[i].score;
-
-        // Don't allow crazy blunders even at very low skills
-        if (i > 0 && RootMoves[i - 1].score > score + Options["Skill Level Maximum Error"] * PawnValueMg) ///PATCH: Actually, yes, possibly allow crazy blunders (http://support.stockfishchess.org/discussions/suggestions/94-skill-level-request-to-spread-the-skill-over-a-wider-range)
-            break;
-
-        // This is our magic formula
-        score += (  weakness * int(RootMoves[0].score - score)
-                  + variance * (rng.rand<unsigned>() % weakness)) / Options["Skill Level Probability"]; ///PATCH
-
-        if (score > maxScore)
-        {
-            maxScore = score;
-            best = RootMoves[i].pv[0];
-        }
-    }
-    return best;
-  }
-
 
   // uci_pv() formats PV information according to the UCI protocol. UCI
   // requires that all (if any) unsearched PV lines are sent using a previous
@@ -1414,8 +1709,14 @@ moves_loop: // When in check and at SpNode search starts from here
 
   string uci_pv(const Position& pos, Depth depth, Value alpha, Value beta) {
 
+    Engine& e = *pos.this_thread()->engine;
+    ThreadPool& Threads = e.threads;
+    const RootMoveVector& RootMoves = e.rootMoves;
+    const size_t PVIdx = e.pvIdx;
+
     std::stringstream ss;
-    Time::point elapsed = Time::now() - SearchTime + 1;
+    Time::point elapsed = Time::now() - e.searchTime + 1;
+    uint64_t nodes = Threads.nodes_searched();
     size_t uciPVSize = std::min((size_t)Options["MultiPV"], RootMoves.size());
     int selDepth = 0;
 
@@ -1444,9 +1745,13 @@ moves_loop: // When in check and at SpNode search starts from here
         if (i == PVIdx)
               ss << (v >= beta ? " lowerbound" : v <= alpha ? " upperbound" : "");
 
-        ss << " nodes "     << pos.nodes_searched()
-           << " nps "       << pos.nodes_searched() * 1000 / elapsed
-           << " time "      << elapsed
+        ss << " nodes "     << nodes
+           << " nps "       << nodes * 1000 / elapsed;
+
+        if (elapsed > 1000) // Earlier the table is mostly empty anyway
+            ss << " hashfull " << e.tt->hashfull();
+
+        ss << " time "      << elapsed
            << " pv";
 
         for (size_t j = 0; j < RootMoves[i].pv.size(); ++j)
@@ -1459,47 +1764,59 @@ moves_loop: // When in check and at SpNode search starts from here
 } // namespace
 
 
-/// RootMove::insert_pv_in_tt() is called at the end of a search iteration, and
-/// inserts the PV back into the TT. This makes sure the old PV moves are searched
-/// first, even if the old TT entries have been overwritten.
+/// When playing with a strength handicap, choose best move among the first 'candidates'
+/// root moves using a statistical rule dependent on 'level'. Idea by Heinz van Saanen.
+
+Move Skill::pick_move(const RootMoveVector& RootMoves) {
 
-void RootMove::insert_pv_in_tt(Position& pos) {
+  // PRNG sequence should be non-deterministic, so we seed it with the time at init
+  static PRNG rng(Time::now());
 
-  StateInfo state[MAX_PLY], *st = state;
-  size_t idx = 0;
+  // RootMoves are already sorted by score in descending order
+  int variance = std::min(RootMoves[0].score - RootMoves[candidates - 1].score, PawnValueMg);
+  int weakness = 120 - 2 * level;
+  int maxScore = -VALUE_INFINITE;
+  best = MOVE_NONE;
 
-  for ( ; idx < pv.size(); ++idx)
+  // Choose best move. For each move score we add two terms both dependent on
+  // weakness. One deterministic and bigger for weaker moves, and one random,
+  // then we choose the move with the resulting highest score.
+  for (size_t i = 0; i < candidates; ++i)
   {
-      bool ttHit;
-      TTEntry* tte = TT.probe(pos.key(), ttHit);
+      int score = RootMoves[i].score;
 
-      if (!ttHit || tte->move() != pv[idx]) // Don't overwrite correct entries
-          tte->save(pos.key(), VALUE_NONE, BOUND_NONE, DEPTH_NONE, pv[idx], VALUE_NONE, TT.generation());
+      // Don't allow crazy blunders even at very low skills
+      if (i > 0 && RootMoves[i - 1].score > score + Options["Skill Level Maximum Error"] * PawnValueMg) ///PATCH: Actually, yes, possibly allow crazy blunders (http://support.stockfishchess.org/discussions/suggestions/94-skill-level-request-to-spread-the-skill-over-a-wider-range)
+          break;
 
-      assert(MoveList<LEGAL>(pos).contains(pv[idx]));
+      // This is our magic formula
+      score += (  weakness * int(RootMoves[0].score - score)
+                + variance * (rng.rand<unsigned>() % weakness)) / Options["Skill Level Probability"]; ///PATCH
 
-      pos.do_move(pv[idx], *st++);
+      if (score > maxScore)
+      {
+          maxScore = score;
+          best = RootMoves[i].pv[0];
+      }
   }
-
-  while (idx) pos.undo_move(pv[--idx]);
+  return best;
 }
 
 
-/// RootMove::extract_ponder_from_tt() is called in case we have no ponder move before
+/// RootMove::extract_ponder() is called in case we have no ponder move before
 /// exiting the search, for instance in case we stop the search during a fail high at
 /// root. We try hard to have a ponder move to return to the GUI, otherwise in case of
-/// 'ponder on' we have nothing to think on.
+/// 'ponder on' we have nothing to think on. The reply is the move of the PV table,
+/// if the position after the best move was a PV node.
 
-Move RootMove::extract_ponder_from_tt(Position& pos)
+Move RootMove::extract_ponder(Position& pos)
 {
     StateInfo st;
-    bool found;
 
     assert(pv.size() == 1);
 
     pos.do_move(pv[0], st);
-    TTEntry* tte = TT.probe(pos.key(), found);
-    Move m = found ? tte->move() : MOVE_NONE;
+    Move m = pos.this_thread()->engine->pvTable.probe(pos.key());
     if (!MoveList<LEGAL>(pos).contains(m))
         m = MOVE_NONE;
 
@@ -1524,12 +1841,22 @@ void Thread::idle_loop() {
       // If this thread has been assigned work, launch a search
       while (searching)
       {
-          Threads.mutex.lock();
-
-          assert(activeSplitPoint);
+          // The master booking us sets the split point before 'searching'
+          memory_barrier();
           SplitPoint* sp = activeSplitPoint;
 
-          Threads.mutex.unlock();
+          // Lazy SMP helpers are started without a split point and search
+          // until the main thread raises Signals.stop.
+          if (!sp)
+          {
+              helper_loop(this);
+
+              mutex.lock();
+              searching = false;
+              sleepCondition.notify_one(); // Wake up the main thread in wait_while()
+              mutex.unlock();
+              break;
+          }
 
           Stack stack[MAX_PLY+4], *ss = stack+2; // To allow referencing (ss-2) and (ss+2)
           Position pos(*sp->pos, this);
@@ -1538,11 +1865,14 @@ void Thread::idle_loop() {
           ss->splitPoint = sp;
 
           sp->mutex.lock();
+          mutex.lock();
 
           assert(activePosition == NULL);
 
           activePosition = &pos;
 
+          mutex.unlock();
+
           if (sp->nodeType == NonPV)
               search<NonPV, true>(pos, ss, sp->alpha, sp->beta, sp->depth, sp->cutNode);
 
@@ -1557,8 +1887,14 @@ void Thread::idle_loop() {
 
           assert(searching);
 
+          mutex.lock(); // Read by check_time()
+
           searching = false;
           activePosition = NULL;
+          splitNodes += pos.nodes_searched();
+
+          mutex.unlock();
+
           sp->slavesMask.reset(idx);
           sp->allSlavesSearching = false;
           sp->nodes += pos.nodes_searched();
@@ -1578,35 +1914,49 @@ void Thread::idle_loop() {
           sp->mutex.unlock();
 
           // Try to late join to another split point if none of its slaves has
-          // already finished.
+          // already finished. Victims are scanned from a random thread so that
+          // idle threads spread over the masters instead of piling on the first.
+          ThreadPool& Threads = engine->threads;
+
           if (Threads.size() > 2)
-              for (size_t i = 0; i < Threads.size(); ++i)
+          {
+              size_t victim = rng.rand<unsigned>() % Threads.size();
+
+              for (size_t i = 0; i < Threads.size(); ++i, victim = (victim + 1) % Threads.size())
               {
-                  const int size = Threads[i]->splitPointsSize; // Local copy
-                  sp = size ? &Threads[i]->splitPoints[size - 1] : NULL;
+                  Thread* th = Threads[victim];
+                  const int size = th->splitPointsSize; // Local copy
+                  sp = size ? &th->splitPoints[size - 1] : NULL;
 
                   if (   sp
                       && sp->allSlavesSearching
-                      && available_to(Threads[i]))
+                      && available_to(th))
                   {
-                      // Recheck the conditions under lock protection
-                      Threads.mutex.lock();
+                      // Recheck the conditions under lock protection. A split
+                      // point with all its slaves searching cannot be released.
+                      // We book ourselves like a master would, see split(), and
+                      // give up if a master is booking us at the same time.
                       sp->mutex.lock();
 
-                      if (   sp->allSlavesSearching
-                          && available_to(Threads[i]))
+                      if (book())
                       {
-                           sp->slavesMask.set(idx);
-                           activeSplitPoint = sp;
-                           searching = true;
+                          if (   sp->allSlavesSearching
+                              && available_to(th))
+                          {
+                              sp->slavesMask.set(idx);
+                              activeSplitPoint = sp;
+                              searching = true;
+                          }
+
+                          unbook();
                       }
 
                       sp->mutex.unlock();
-                      Threads.mutex.unlock();
 
                       break; // Just a single attempt
                   }
               }
+          }
       }
 
       // Grab the lock to avoid races with Thread::notify_one()
@@ -1634,10 +1984,15 @@ void Thread::idle_loop() {
 /// used to print debug info and, more importantly, to detect when we are out of
 /// available time and thus stop the search.
 
-void check_time() {
+void check_time(Engine& e) {
+
+  ThreadPool& Threads = e.threads;
+  volatile SignalsType& Signals = e.signals;
+  const LimitsType& Limits = e.limits;
+  const TimeManager& TimeMgr = e.timeMgr;
 
   static Time::point lastInfoTime = Time::now();
-  Time::point elapsed = Time::now() - SearchTime;
+  Time::point elapsed = Time::now() - e.searchTime;
 
   if (Time::now() - lastInfoTime >= 1000)
   {
@@ -1664,29 +2019,26 @@ void check_time() {
 
   else if (Limits.nodes)
   {
-      Threads.mutex.lock();
-
-      int64_t nodes = RootPos.nodes_searched();
+      int64_t nodes = Threads.nodes_searched();
 
-      // Loop across all split points and sum accumulated SplitPoint nodes plus
-      // all the currently active positions nodes.
+      // Add the nodes of the split points not finished yet: the shares of the
+      // slaves that are done are in their splitNodes, those still searching in
+      // their active position. A thread changes both under its own lock and
+      // clears activePosition before the position goes out of scope, so they
+      // are safe to read under that lock, without walking the split points.
       for (size_t i = 0; i < Threads.size(); ++i)
-          for (int j = 0; j < Threads[i]->splitPointsSize; ++j)
-          {
-              SplitPoint& sp = Threads[i]->splitPoints[j];
+      {
+          Thread* th = Threads[i];
 
-              sp.mutex.lock();
+          th->mutex.lock();
 
-              nodes += sp.nodes;
+          nodes += th->splitNodes;
 
-              for (size_t idx = 0; idx < Threads.size(); ++idx)
-                  if (sp.slavesMask.test(idx) && Threads[idx]->activePosition)
-                      nodes += Threads[idx]->activePosition->nodes_searched();
+          if (th->activePosition && th->activePosition != &e.rootPos)
+              nodes += th->activePosition->nodes_searched();
 
-              sp.mutex.unlock();
-          }
-
-      Threads.mutex.unlock();
+          th->mutex.unlock();
+      }
 
       if (nodes >= Limits.nodes)
           Signals.stop = true;
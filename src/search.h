@@ -20,6 +20,8 @@
 #ifndef SEARCH_H_INCLUDED
 #define SEARCH_H_INCLUDED
 
+#include <algorithm>
+#include <cstring>   // For std::memset
 #include <memory>  // For std::auto_ptr
 #include <stack>
 #include <vector>
@@ -28,6 +30,7 @@
 #include "position.h"
 #include "types.h"
 
+struct Engine;
 struct SplitPoint;
 
 namespace Search {
@@ -59,8 +62,7 @@ struct RootMove {
 
   bool operator<(const RootMove& m) const { return score > m.score; } // Ascending sort
   bool operator==(const Move& m) const { return pv[0] == m; }
-  void insert_pv_in_tt(Position& pos);
-  Move extract_ponder_from_tt(Position& pos);
+  Move extract_ponder(Position& pos);
 
   Value score;
   Value previousScore;
@@ -69,6 +71,38 @@ struct RootMove {
 
 typedef std::vector<RootMove> RootMoveVector;
 
+/// PVTable is a small hash table of the best moves found at PV nodes. The search
+/// updates it together with the PV, so the moves of the previous PVs (of all
+/// the MultiPV lines) are searched first without being written back into the
+/// TT. The key is stored XOR-ed with the move, so that an entry torn by a
+/// concurrent write reads as a miss.
+
+struct PVTable {
+
+  static const int Size = 4096;
+
+  void clear() { std::memset(table, 0, sizeof(table)); }
+
+  Move probe(Key key) const {
+    const Entry& e = table[key & (Size - 1)];
+    uint64_t move = e.move;
+    return (e.key ^ move) == key ? Move(move) : MOVE_NONE;
+  }
+
+  void save(Key key, Move m) {
+    Entry& e = table[key & (Size - 1)];
+    e.key = key ^ uint64_t(m);
+    e.move = uint64_t(m);
+  }
+
+private:
+  struct Entry {
+    volatile uint64_t key, move;
+  };
+
+  Entry table[Size];
+};
+
 /// LimitsType struct stores information sent by GUI about available time to
 /// search the current move, maximum depth/time, if we are in analysis mode or
 /// if we have to ponder while it's our opponent's turn to move.
@@ -96,18 +130,32 @@ struct SignalsType {
   bool stop, stopOnPonderhit, firstRootMove, failedLowAtRoot;
 };
 
-typedef std::auto_ptr<std::stack<StateInfo> > StateStackPtr;
+/// Skill struct is used to implement strength handicap. When the level is
+/// below 20 the search looks at a few candidate moves with MultiPV and picks
+/// a sub-optimal one among them.
+
+struct Skill {
+  Skill() : level(20), candidates(0), best(MOVE_NONE) {}
+  Skill(int l, size_t rootSize) : level(l),
+                                  candidates(l < 20 ? std::min(4, (int)rootSize) : 0),
+                                  best(MOVE_NONE) {}
+  ///NOTE: The deconstructor, ~Skill(), breaks stuff when compiled to JavaScript. This code was moved to async_loop().
 
-extern volatile SignalsType Signals;
-extern LimitsType Limits;
-extern RootMoveVector RootMoves;
-extern Position RootPos;
-extern Time::point SearchTime;
-extern StateStackPtr SetupStates;
+  size_t candidates_size() const { return candidates; }
+  bool time_to_pick(Depth depth) const { return depth / ONE_PLY == 1 + level; }
+  Move pick_move(const RootMoveVector& rootMoves);
+
+  int level;
+  size_t candidates;
+  Move best;
+};
+
+typedef std::auto_ptr<std::stack<StateInfo> > StateStackPtr;
 
 void init();
-void think();
-template<bool Root> uint64_t perft(Position& pos, Depth depth);
+void think(Engine& e);
+uint64_t perft(Position& pos, Depth depth);
+Value quiescence(Position& pos);
 
 } // namespace Search
 
@@ -29,31 +29,31 @@
 #include <algorithm> // For std::count
 #include <cassert>
 
+#include "engine.h"
 #include "movegen.h"
+#include "numa.h"
 #include "search.h"
 #include "thread.h"
 #include "uci.h"
 
 using namespace Search;
 
-ThreadPool Threads; // Global object
-
-extern void check_time();
+extern void check_time(Engine& e);
 
 namespace {
 
  // start_routine() is the C function which is called when a new thread
  // is launched. It is a wrapper to the virtual function idle_loop().
 
- extern "C" { long start_routine(ThreadBase* th) { th->idle_loop(); return 0; } }
+ extern "C" { void* start_routine(void* th) { static_cast<ThreadBase*>(th)->idle_loop(); return NULL; } }
 
 
  // Helpers to launch a thread after creation and joining before delete. Must be
  // outside Thread c'tor and d'tor because the object must be fully initialized
  // when start_routine (and hence virtual idle_loop) is called and when joining.
 
- template<typename T> T* new_thread() {
-   T* th = new T();
+ template<typename T> T* new_thread(Engine* e) {
+   T* th = new T(e);
    thread_create(th->handle, start_routine, th); // Will go to sleep
    return th;
  }
@@ -92,16 +92,33 @@ void ThreadBase::wait_for(volatile const bool& condition) {
 }
 
 
+// ThreadBase::wait_while() set the thread to sleep until 'condition' turns false
+
+void ThreadBase::wait_while(volatile const bool& condition) {
+
+  mutex.lock();
+  while (condition) sleepCondition.wait(mutex);
+  mutex.unlock();
+}
+
+
 // Thread c'tor makes some init but does not launch any execution thread that
 // will be started only when c'tor returns.
 
-Thread::Thread() /* : splitPoints() */ { // Initialization of non POD broken in MSVC
+Thread::Thread(Engine* e) : ThreadBase(e), rng(e->threads.size() + 1) /* , splitPoints() */ { // Initialization of non POD broken in MSVC
 
   searching = false;
+  booking = 0;
   maxPly = splitPointsSize = 0;
+  numaNode = -1;
+  splitNodes = 0;
+  pawnProbes = pawnHits = materialProbes = materialHits = 0;
+  evals = lazyEvals = 0;
   activeSplitPoint = NULL;
   activePosition = NULL;
-  idx = Threads.size(); // Starts from 0
+  rootPos.set_nodes_searched(0);
+  completedDepth = DEPTH_ZERO;
+  idx = e->threads.size(); // Starts from 0
 }
 
 
@@ -126,7 +143,11 @@ bool Thread::cutoff_occurred() const {
 // stack (the "helpful master concept" in YBWC terminology).
 
 bool Thread::available_to(const Thread* master) const {
-return false;
+
+#ifdef NO_THREADS
+  return false; // Helper threads never run in single threaded Stockfish.js
+#endif
+
   if (searching)
       return false;
 
@@ -140,6 +161,46 @@ return false;
 }
 
 
+// Thread::bind() moves the thread and its pawn and material tables to a NUMA
+// node, or lets the thread run anywhere again if node is negative. Tables are
+// left where they are in that case.
+
+void Thread::bind(int node) {
+
+  if (node == numaNode)
+      return;
+
+  numaNode = node;
+  NUMA::bind_thread(handle, node);
+
+  if (node >= 0)
+  {
+      NUMA::bind_memory(this, sizeof(Thread), node);
+      NUMA::bind_memory(pawnsTable[0], pawnsTable.bytes(), node);
+      NUMA::bind_memory(materialTable[0], materialTable.bytes(), node);
+  }
+}
+
+
+// Thread::nodes_searched() returns the nodes searched by this thread alone. A
+// thread counts the nodes of its share of each split point in splitNodes, and
+// the master discounts them there when it adds the split point nodes back to
+// its own position, so that every node is counted once.
+
+uint64_t Thread::nodes_searched() const {
+
+  int64_t nodes = splitNodes;
+
+  if (this == engine->threads[0])
+      nodes += engine->rootPos.nodes_searched();
+
+  else if (engine->threads.lazySMP)
+      nodes += rootPos.nodes_searched();
+
+  return nodes;
+}
+
+
 // Thread::split() does the actual work of distributing the work at a node between
 // several available threads. If it does not succeed in splitting the node
 // (because no idle threads are available), the function immediately returns.
@@ -155,7 +216,7 @@ void Thread::split(Position& pos, Stack* ss, Value alpha, Value beta, Value* bes
 
   assert(searching);
   assert(-VALUE_INFINITE < *bestValue && *bestValue <= alpha && alpha < beta && beta <= VALUE_INFINITE);
-  assert(depth >= Threads.minimumSplitDepth);
+  assert(depth >= engine->threads.minimumSplitDepth);
   assert(splitPointsSize < MAX_SPLITPOINTS_PER_THREAD);
 
   // Pick and init the next available split point
@@ -163,7 +224,7 @@ void Thread::split(Position& pos, Stack* ss, Value alpha, Value beta, Value* bes
 
   sp.masterThread = this;
   sp.parentSplitPoint = activeSplitPoint;
-  sp.slavesMask = 0, sp.slavesMask.set(idx);
+  sp.slavesMask.clear(), sp.slavesMask.set(idx);
   sp.depth = depth;
   sp.bestValue = *bestValue;
   sp.bestMove = *bestMove;
@@ -178,25 +239,44 @@ void Thread::split(Position& pos, Stack* ss, Value alpha, Value beta, Value* bes
   sp.cutoff = false;
   sp.ss = ss;
 
-  // Try to allocate available threads and ask them to start searching setting
-  // 'searching' flag. This must be done under lock protection to avoid concurrent
-  // allocation of the same slave by another master.
-  Threads.mutex.lock();
   sp.mutex.lock();
 
   sp.allSlavesSearching = true; // Must be set under lock protection
   ++splitPointsSize;
+
+  mutex.lock(); // activePosition is read by check_time()
   activeSplitPoint = &sp;
   activePosition = NULL;
+  mutex.unlock();
 
-  Thread* slave;
+  // Try to allocate available threads and ask them to start searching setting
+  // 'searching' flag. A slave is booked without locking: the master claims the
+  // slave's booking word with a compare-and-swap, and skips the slave instead
+  // of waiting when another thread holds it. Nothing that available_to() reads
+  // can change while the word is held, so the recheck is final.
+  ThreadPool& threads = engine->threads;
 
-  while ((slave = Threads.available_slave(this)) != NULL)
+  for (size_t i = 0; i < threads.size(); ++i)
   {
-      sp.slavesMask.set(slave->idx);
-      slave->activeSplitPoint = &sp;
-      slave->searching = true; // Slave leaves idle_loop()
-      slave->notify_one(); // Could be sleeping
+      Thread* slave = threads[i];
+
+      if (!slave->available_to(this) || !slave->book())
+          continue;
+
+      bool booked = slave->available_to(this);
+
+      if (booked)
+      {
+          sp.slavesMask.set(slave->idx);
+          slave->activeSplitPoint = &sp;
+          memory_barrier(); // The slave reads activeSplitPoint once 'searching' is set
+          slave->searching = true; // Slave leaves idle_loop()
+      }
+
+      slave->unbook();
+
+      if (booked)
+          slave->notify_one(); // Could be sleeping
   }
 
   // Everything is set up. The master thread enters the idle loop, from which
@@ -204,7 +284,6 @@ void Thread::split(Position& pos, Stack* ss, Value alpha, Value beta, Value* bes
   // The thread will return from the idle loop when all slaves have finished
   // their work at this split point.
   sp.mutex.unlock();
-  Threads.mutex.unlock();
 
   Thread::idle_loop(); // Force a call to base class idle_loop()
 
@@ -216,20 +295,25 @@ void Thread::split(Position& pos, Stack* ss, Value alpha, Value beta, Value* bes
 
   // We have returned from the idle loop, which means that all threads are
   // finished. Note that setting 'searching' and decreasing splitPointsSize must
-  // be done under lock protection to avoid a race with Thread::available_to().
-  Threads.mutex.lock();
+  // be done holding our booking word to avoid a race with a master booking us.
+  // A master holds it only for a few instructions, so just spin.
+  while (!book()) {}
+
   sp.mutex.lock();
+  mutex.lock(); // activePosition is read by check_time()
 
   searching = true;
   --splitPointsSize;
   activeSplitPoint = sp.parentSplitPoint;
   activePosition = &pos;
   pos.set_nodes_searched(pos.nodes_searched() + sp.nodes);
+  splitNodes -= sp.nodes;
   *bestMove = sp.bestMove;
   *bestValue = sp.bestValue;
 
+  mutex.unlock();
   sp.mutex.unlock();
-  Threads.mutex.unlock();
+  unbook();
 }
 
 
@@ -248,7 +332,7 @@ void TimerThread::idle_loop() {
       mutex.unlock();
 
       if (run)
-          check_time();
+          check_time(*engine);
   }
 }
 
@@ -266,7 +350,7 @@ void MainThread::idle_loop() {
 
       while (!thinking && !exit)
       {
-          Threads.sleepCondition.notify_one(); // Wake up the UI thread if needed
+          engine->threads.sleepCondition.notify_one(); // Wake up the UI thread if needed
           sleepCondition.wait(mutex);
       }
 
@@ -276,7 +360,7 @@ void MainThread::idle_loop() {
       {
           searching = true;
 
-          Search::think();
+          Search::think(*engine);
 
           assert(searching);
 
@@ -287,16 +371,18 @@ void MainThread::idle_loop() {
 
 
 // ThreadPool::init() is called at startup to create and launch requested threads,
-// that will go immediately to sleep. We cannot use a c'tor because Threads is a
-// static object and we need a fully initialized engine at this point due to
-// allocation of Endgames in Thread c'tor.
+// that will go immediately to sleep. We cannot use a c'tor because the pool is
+// part of a static engine object and we need a fully initialized engine at this
+// point due to allocation of Endgames in Thread c'tor.
+
+void ThreadPool::init(Engine* e) {
 
-void ThreadPool::init() {
+  engine = e;
 ///emscripten_run_script("console.log('thread0');console.time('thread0')");
-  timer = new_thread<TimerThread>();
+  timer = new_thread<TimerThread>(engine);
 ///emscripten_run_script("console.timeEnd('thread0')");
 ///emscripten_run_script("console.log('thread1');console.time('thread1')");
-  push_back(new_thread<MainThread>());
+  push_back(new_thread<MainThread>(engine));
 ///emscripten_run_script("console.timeEnd('thread1')");
 ///emscripten_run_script("console.log('thread2');console.time('thread2')");
   read_uci_options();
@@ -325,7 +411,12 @@ void ThreadPool::exit() {
 void ThreadPool::read_uci_options() {
 
   minimumSplitDepth = Options["Min Split Depth"] * ONE_PLY;
-  size_t requested  = Options["Threads"];
+  size_t requested  = engine->threadCount ? engine->threadCount : size_t(Options["Threads"]);
+#ifdef NO_THREADS
+  lazySMP = false; // Helper threads never run in single threaded Stockfish.js
+#else
+  lazySMP = Options["Lazy SMP"];
+#endif
 
   assert(requested > 0);
 
@@ -334,33 +425,45 @@ void ThreadPool::read_uci_options() {
       minimumSplitDepth = requested < 8 ? 4 * ONE_PLY : 7 * ONE_PLY;
 
   while (size() < requested)
-      push_back(new_thread<Thread>());
+      push_back(new_thread<Thread>(engine));
 
   while (size() > requested)
   {
       delete_thread(back());
       pop_back();
   }
+
+  for (size_t i = 0; i < size(); ++i)
+      at(i)->bind(Options["NUMA Binding"] ? NUMA::node_of(i, size()) : -1);
 }
 
 
-// ThreadPool::available_slave() tries to find an idle thread which is available
-// as a slave for the thread 'master'.
+// ThreadPool::nodes_searched() returns the nodes searched so far. Split point
+// nodes are added back to the main thread, but Lazy SMP helpers count their
+// own nodes on their root position.
+
+uint64_t ThreadPool::nodes_searched() {
 
-Thread* ThreadPool::available_slave(const Thread* master) const {
+  uint64_t nodes = engine->rootPos.nodes_searched();
 
-  for (const_iterator it = begin(); it != end(); ++it)
-      if ((*it)->available_to(master))
-          return *it;
+  if (lazySMP)
+      for (size_t i = 1; i < size(); ++i)
+          nodes += at(i)->rootPos.nodes_searched();
 
-  return NULL;
+  return nodes;
 }
 
 
 // ThreadPool::wait_for_think_finished() waits for main thread to finish the search
 
 void ThreadPool::wait_for_think_finished() {
-/// Empty for Stockfish.js.
+/// Empty for single threaded Stockfish.js.
+#ifndef NO_THREADS
+  MainThread* th = main();
+  th->mutex.lock();
+  while (th->thinking) sleepCondition.wait(th->mutex);
+  th->mutex.unlock();
+#endif
 }
 
 
@@ -371,24 +474,31 @@ void ThreadPool::start_thinking(const Position& pos, const LimitsType& limits,
                                 StateStackPtr& states) {
   wait_for_think_finished();
 
-  SearchTime = Time::now(); // As early as possible
+  Engine& e = *engine;
+
+  e.searchTime = Time::now(); // As early as possible
 
-  Signals.stopOnPonderhit = Signals.firstRootMove = false;
-  Signals.stop = Signals.failedLowAtRoot = false;
+  e.signals.stopOnPonderhit = e.signals.firstRootMove = false;
+  e.signals.stop = e.signals.failedLowAtRoot = false;
 
-  RootMoves.clear();
-  RootPos = pos;
-  Limits = limits;
+  e.rootMoves.clear();
+  e.rootPos = pos;
+  e.limits = limits;
   if (states.get()) // If we don't set a new position, preserve current state
   {
-      SetupStates = states; // Ownership transfer here
+      e.setupStates = states; // Ownership transfer here
       assert(!states.get());
   }
 
   for (MoveList<LEGAL> it(pos); *it; ++it)
       if (   limits.searchmoves.empty()
           || std::count(limits.searchmoves.begin(), limits.searchmoves.end(), *it))
-          RootMoves.push_back(RootMove(*it));
+          e.rootMoves.push_back(RootMove(*it));
 
-  Search::think();
+#ifdef NO_THREADS
+  Search::think(e);
+#else
+  main()->thinking = true;
+  main()->notify_one(); // Starts main thread
+#endif
 }
@@ -20,7 +20,6 @@
 #ifndef THREAD_H_INCLUDED
 #define THREAD_H_INCLUDED
 
-#include <bitset>
 #include <vector>
 
 #include "material.h"
@@ -29,6 +28,7 @@
 #include "position.h"
 #include "search.h"
 
+struct Engine;
 struct Thread;
 
 const int MAX_THREADS = 128;
@@ -63,8 +63,41 @@ private:
 };
 
 
+/// SlavesMask is the set of the threads searching at a split point. Bits are
+/// set and reset atomically and 'size' counts them, so that a thread can test
+/// whether the set is empty reading a single word.
+
+struct SlavesMask {
+
+  void clear() {
+    for (int i = 0; i < MAX_THREADS / 32; ++i)
+        bits[i] = 0;
+    size = 0;
+  }
+
+  void set(size_t idx) {
+    atomic_or(bits[idx / 32], 1U << (idx % 32));
+    atomic_add(size, 1);
+  }
+
+  void reset(size_t idx) {
+    atomic_and(bits[idx / 32], ~(1U << (idx % 32)));
+    atomic_add(size, -1);
+  }
+
+  bool test(size_t idx) const { return bits[idx / 32] & (1U << (idx % 32)); }
+  bool none() const { return !size; }
+
+  volatile uint32_t bits[MAX_THREADS / 32];
+  volatile int size;
+};
+
+
 /// SplitPoint struct stores information shared by the threads searching in
 /// parallel below the same split point. It is populated at splitting time.
+/// The split point stack of each thread is the queue idle threads late join
+/// from. The shared data is guarded by the split point mutex, that also guards
+/// the MovePicker, except slavesMask and moveCount that are updated atomically.
 
 struct SplitPoint {
 
@@ -83,7 +116,7 @@ struct SplitPoint {
 
   // Shared variable data
   Mutex mutex;
-  std::bitset<MAX_THREADS> slavesMask;
+  SlavesMask slavesMask;
   volatile bool allSlavesSearching;
   volatile uint64_t nodes;
   volatile Value alpha;
@@ -99,12 +132,14 @@ struct SplitPoint {
 
 struct ThreadBase {
 
-  ThreadBase() : handle(NativeHandle()), exit(false) {}
+  ThreadBase(Engine* e) : engine(e), handle(NativeHandle()), exit(false) {}
   virtual ~ThreadBase() {}
   virtual void idle_loop() = 0;
   void notify_one();
   void wait_for(volatile const bool& b);
+  void wait_while(volatile const bool& b);
 
+  Engine* engine;
   Mutex mutex;
   ConditionVariable sleepCondition;
   NativeHandle handle;
@@ -116,13 +151,18 @@ struct ThreadBase {
 /// and especially split points. We also use per-thread pawn and material hash
 /// tables so that once we get a pointer to an entry its life time is unlimited
 /// and we don't have to care about someone changing the entry under our feet.
+/// When the tables are shared instead, the entry in use is a per-thread copy.
 
 struct Thread : public ThreadBase {
 
-  Thread();
+  Thread(Engine* e);
   virtual void idle_loop();
   bool cutoff_occurred() const;
   bool available_to(const Thread* master) const;
+  bool book() { return atomic_cas(booking, 0, 1); }
+  void unbook() { memory_barrier(); booking = 0; }
+  void bind(int node);
+  uint64_t nodes_searched() const;
 
   void split(Position& pos, Search::Stack* ss, Value alpha, Value beta, Value* bestValue, Move* bestMove,
              Depth depth, int moveCount, MovePicker* movePicker, int nodeType, bool cutNode);
@@ -130,13 +170,26 @@ struct Thread : public ThreadBase {
   SplitPoint splitPoints[MAX_SPLITPOINTS_PER_THREAD];
   Pawns::Table pawnsTable;
   Material::Table materialTable;
+  Pawns::Entry pawnEntry;          // Copies of the entries in use when the engine
+  Material::Entry materialEntry;   // has shared pawn and material tables
+  uint64_t pawnProbes, pawnHits, materialProbes, materialHits;
+  uint64_t evals, lazyEvals;
   Endgames endgames;
   Position* activePosition;
+  PRNG rng;
   size_t idx;
   int maxPly;
+  int numaNode;
+  int64_t splitNodes;
   SplitPoint* volatile activeSplitPoint;
   volatile int splitPointsSize;
   volatile bool searching;
+  volatile int booking; // Held by whoever sets 'searching' to true, see split()
+
+  // Lazy SMP helpers search on their own copy of the root position and moves
+  Position rootPos;
+  Search::RootMoveVector rootMoves;
+  Depth completedDepth;
 };
 
 
@@ -144,7 +197,7 @@ struct Thread : public ThreadBase {
 /// special threads: the main one and the recurring timer.
 
 struct MainThread : public Thread {
-  MainThread() : thinking(true) {} // Avoid a race with start_thinking()
+  MainThread(Engine* e) : Thread(e), thinking(true) {} // Avoid a race with start_thinking()
   virtual void idle_loop();
   volatile bool thinking;
 };
@@ -153,7 +206,7 @@ struct TimerThread : public ThreadBase {
 
   static const int Resolution = 5; // Millisec between two check_time() calls
 
-  TimerThread() : run(false) {}
+  TimerThread(Engine* e) : ThreadBase(e), run(false) {}
   virtual void idle_loop();
 
   bool run;
@@ -166,21 +219,20 @@ struct TimerThread : public ThreadBase {
 
 struct ThreadPool : public std::vector<Thread*> {
 
-  void init(); // No c'tor and d'tor, threads rely on globals that should be
-  void exit(); // initialized and are valid during the whole thread lifetime.
+  void init(Engine* e); // No c'tor and d'tor, threads rely on globals that should be
+  void exit();          // initialized and are valid during the whole thread lifetime.
 
   MainThread* main() { return static_cast<MainThread*>(at(0)); }
   void read_uci_options();
-  Thread* available_slave(const Thread* master) const;
   void wait_for_think_finished();
   void start_thinking(const Position&, const Search::LimitsType&, Search::StateStackPtr&);
+  uint64_t nodes_searched();
 
+  Engine* engine;
   Depth minimumSplitDepth;
-  Mutex mutex;
+  bool lazySMP;
   ConditionVariable sleepCondition;
   TimerThread* timer;
 };
 
-extern ThreadPool Threads;
-
 #endif // #ifndef THREAD_H_INCLUDED
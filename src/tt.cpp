@@ -18,19 +18,84 @@
 */
 
 #include <cstring>   // For std::memset
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+
+#if defined(__linux__) && !defined(EMSCRIPTEN)
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
 
 #include "bitboard.h"
+#include "numa.h"
+#include "position.h"
+#include "thread.h"
 #include "tt.h"
+#include "uci.h"
+
+namespace {
+
+  // A table file starts with a header page followed by the raw cluster array,
+  // so that the clusters of a mapped file are aligned like allocated ones.
+  const size_t HeaderSize = 4096;
+  const char Magic[8] = { 'S', 'F', 'T', 'T', 'v', '2', 0, 0 };
+
+  struct FileHeader {
+    char magic[8];
+    uint32_t clusterSize;  // Entries per cluster
+    uint32_t clusterBytes; // sizeof(Cluster)
+    uint64_t clusterCount;
+    uint64_t zobrist;      // Fingerprint of the Zobrist keys
+    uint8_t generation8;
+    uint16_t epoch16;
+  };
+
+  // The stored keys are only meaningful if this binary hashes positions the
+  // same way as the one that wrote the file, so check a couple of sample keys
+  // that cover pieces, castling rights, en passant and the side to move.
+  uint64_t zobrist_fingerprint() {
+
+    Key k1 = Position("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", false, NULL).key();
+    Key k2 = Position("rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3", false, NULL).key();
+    Key k3 = Position("r3k2r/8/8/8/8/8/8/R3K2R b Kq - 0 1", false, NULL).key();
+
+    return k1 ^ (k2 << 1 | k2 >> 63) ^ (k3 << 2 | k3 >> 62);
+  }
 
-TranspositionTable TT; // Our global transposition table
+} // namespace
+
+
+/// Job is shared by the threads working on the table in parallel, to rehash
+/// it into a resized table or to clear it. Chunks of the (new) table are
+/// handed out in order under the mutex.
+
+struct TranspositionTable::Job {
+  const TranspositionTable* tt;
+  Cluster* newTable; // NULL when clearing
+  size_t newClusterCount;
+  size_t next;
+  Mutex mutex;
+};
+
+namespace { const size_t JobChunk = 1 << 16; } // 2 MB of clusters
 
 
 /// TranspositionTable::resize() sets the size of the transposition table,
 /// measured in megabytes. Transposition table consists of a power of 2 number
 /// of clusters and each cluster consists of ClusterSize number of TTEntry.
+/// The entries of the old table are moved to the new one, so both tables are
+/// allocated for a moment. If the memory is short, the table gets smaller
+/// than asked for and the size used is reported. It is also reported, along
+/// with the kind of pages backing the table, when 'verbose' is set: on an
+/// explicit change of the Hash option, not at startup. The rehash is blocking
+/// but split among the threads: the table is only resized between searches
+/// (the UCI thread waits for the search to finish), so an incremental rehash
+/// would only make every probe() look into two tables.
 
-void TranspositionTable::resize(size_t mbSize) {
+void TranspositionTable::resize(size_t mbSize, bool verbose) {
 
   assert(sizeof(Cluster) == CacheLineSize / 2);
 
@@ -39,52 +104,445 @@ void TranspositionTable::resize(size_t mbSize) {
   if (newClusterCount == clusterCount)
       return;
 
-  clusterCount = newClusterCount;
+  const size_t requested = newClusterCount;
+  const size_t minClusterCount = (1024 * 1024) / sizeof(Cluster);
+  std::string newPages;
+  void* newMem;
 
-  free(mem);
-  mem = calloc(clusterCount * sizeof(Cluster) + CacheLineSize - 1, 1);
+  // When the memory is short (a JS heap can only grow so much) fall back to
+  // the largest table that fits, as long as it is bigger than the current one.
+  while (!(newMem = large_pages_alloc(newClusterCount * sizeof(Cluster), newPages)))
+  {
+      newClusterCount /= 2;
 
-  if (!mem)
+      if (newClusterCount <= clusterCount || newClusterCount < minClusterCount)
+          break;
+  }
+
+  if (!newMem && clusterCount)
+  {
+      sync_cout << "info string Hash " << mbSize << " MB not available, keeping "
+                << (clusterCount * sizeof(Cluster) >> 20) << " MB" << sync_endl;
+      return;
+  }
+
+  if (!newMem)
   {
       std::cerr << "Failed to allocate " << mbSize
                 << "MB for transposition table." << std::endl;
       exit(EXIT_FAILURE);
   }
 
-  table = (Cluster*)((uintptr_t(mem) + CacheLineSize - 1) & ~(CacheLineSize - 1));
+  Cluster* newTable = (Cluster*)newMem; // Aligned to a cache line at least
+
+  // Spread the table over the NUMA nodes before it is first touched
+  NUMA::interleave_memory(newTable, newClusterCount * sizeof(Cluster));
+
+  if (clusterCount)
+  {
+      Job job;
+      job.tt = this;
+      job.newTable = newTable;
+      job.newClusterCount = newClusterCount;
+      run(job);
+  }
+
+  free_table();
+  mem = newMem;
+  memSize = newClusterCount * sizeof(Cluster);
+  table = newTable;
+  clusterCount = newClusterCount;
+  pages = newPages;
+  stats_init();
+
+  if (!verbose && clusterCount == requested)
+      return;
+
+  sync_cout << "info string " << info();
+
+  if (clusterCount < requested)
+      std::cout << ", " << mbSize << " MB not available";
+
+  std::cout << sync_endl;
+}
+
+
+/// TranspositionTable::info() tells the size of the table and the kind of
+/// pages backing it, e.g. "Hash 16 MB in 2048 kB pages (transparent, madvise)".
+
+std::string TranspositionTable::info() const {
+
+  std::stringstream ss;
+  ss << "Hash " << (clusterCount * sizeof(Cluster) >> 20) << " MB in " << pages;
+  return ss.str();
+}
+
+
+/// TranspositionTable::run() splits a job among Options["Threads"] threads,
+/// the calling one included.
+
+void TranspositionTable::run(Job& job) const {
+
+  job.next = 0;
+
+#ifdef NO_THREADS
+  size_t threads = 1; // Helper threads never run in single threaded Stockfish.js
+#else
+  size_t chunks = (job.newClusterCount + JobChunk - 1) / JobChunk;
+  size_t threads = std::min(size_t(Options["Threads"]), chunks);
+#endif
+  std::vector<NativeHandle> handles(threads - 1);
+
+  for (size_t i = 0; i < handles.size(); ++i)
+      thread_create(handles[i], worker, &job);
+
+  worker(&job);
+
+  for (size_t i = 0; i < handles.size(); ++i)
+      thread_join(handles[i]);
+}
+
+
+/// TranspositionTable::worker() is launched for each thread of a job. It takes
+/// chunks of the table until all are done.
+
+void* TranspositionTable::worker(void* arg) {
+
+  Job* job = static_cast<Job*>(arg);
+
+  while (true)
+  {
+      job->mutex.lock();
+      size_t begin = job->next;
+      job->next += JobChunk;
+      job->mutex.unlock();
+
+      if (begin >= job->newClusterCount)
+          break;
+
+      size_t end = std::min(begin + JobChunk, job->newClusterCount);
+
+      if (job->newTable)
+          job->tt->rehash(job->newTable, job->newClusterCount, begin, end);
+      else
+          std::memset(&job->tt->table[begin], 0, (end - begin) * sizeof(Cluster));
+  }
+
+  return NULL;
+}
+
+
+/// TranspositionTable::rehash() fills the clusters [begin, end) of a new table
+/// from the current one. The index of a cluster is the low bits of the key,
+/// so when shrinking, a new cluster gathers the old clusters that agree on the
+/// fewer bits, and keeps the most valuable of their entries: the deepest, an
+/// entry one search older being worth as much as one 4 plies shallower. When
+/// growing, the index bits added by the new table are not stored in the entry,
+/// so each entry is placed once, in the candidate cluster picked by the low
+/// bits of its 16 bit key: only one entry in 'factor' lands in its right
+/// cluster, see the Hash size section of the readme. Entries in the wrong
+/// cluster just miss and are replaced in due time.
+
+void TranspositionTable::rehash(Cluster* newTable, size_t newClusterCount,
+                                size_t begin, size_t end) const {
+
+  const size_t factor = std::max(newClusterCount / clusterCount, size_t(1));
+
+  for (size_t i = begin; i < end; ++i)
+  {
+      uint16_t keys[ClusterSize];
+      uint64_t data[ClusterSize];
+      int worth[ClusterSize];
+      int cnt = 0;
+
+      for (size_t k = i & (clusterCount - 1); k < clusterCount; k += newClusterCount)
+          for (int j = 0; j < ClusterSize && table[k].epoch16 == epoch16; ++j)
+          {
+              TTEntry tte;
+              tte.load(&table[k].key16[j], &table[k].data[j]);
+
+              if (!tte.key16)
+                  continue; // Empty, or a torn entry read as such
+
+              if ((tte.key16 & (factor - 1)) != i / clusterCount)
+                  continue; // Placed in another candidate cluster
+
+              int w = tte.depth8 - uint8_t(generation8 - (tte.genBound8 & 0xFC));
+
+              // Insertion sort, most valuable first
+              int n;
+
+              if (cnt < ClusterSize)
+                  n = cnt++;
+              else if (worth[ClusterSize - 1] < w)
+                  n = ClusterSize - 1;
+              else
+                  continue;
+
+              for ( ; n > 0 && worth[n - 1] < w; --n)
+              {
+                  keys[n] = keys[n - 1];
+                  data[n] = data[n - 1];
+                  worth[n] = worth[n - 1];
+              }
+
+              keys[n] = table[k].key16[j]; // Stored words are moved as they are
+              data[n] = table[k].data[j];
+              worth[n] = w;
+          }
+
+      for (int j = 0; j < ClusterSize; ++j)
+      {
+          newTable[i].key16[j] = j < cnt ? keys[j] : 0;
+          newTable[i].data[j]  = j < cnt ? data[j] : 0;
+      }
+
+      newTable[i].epoch16 = epoch16;
+  }
 }
 
 
 /// TranspositionTable::clear() overwrites the entire transposition table
-/// with zeros. It is called whenever the table is resized, or when the
-/// user asks the program to clear the table (from the UCI interface).
+/// with zeros, split among the threads. It is called when the user asks the
+/// program to clear the table (from the UCI interface). A logical clear only
+/// starts a new epoch: the clusters of older epochs are seen as empty and
+/// are zeroed by probe() when first touched, so the cost of a clear does not
+/// depend on the table size.
+
+void TranspositionTable::clear(bool logical) {
+
+#ifdef TT_STATS
+  counters.reset();
+#endif
+
+  // Clear for real when the epoch wraps, as the oldest clusters would match
+  if (logical && ++epoch16)
+      return;
+
+  epoch16 = 0;
+
+  Job job;
+  job.tt = this;
+  job.newTable = NULL;
+  job.newClusterCount = clusterCount;
+  run(job);
+}
+
+
+/// TranspositionTable::free_table() releases the table memory, unmapping it
+/// if it was mapped from a file by load().
+
+void TranspositionTable::free_table() {
+
+#if defined(__linux__) && !defined(EMSCRIPTEN)
+  if (mapped)
+      munmap(mem, memSize);
+  else
+#endif
+      large_pages_free(mem, memSize);
+
+  mem = NULL;
+  table = NULL;
+  memSize = 0;
+  mapped = false;
+}
+
+
+/// TranspositionTable::save() writes the table to a file, as a header page
+/// with the table size, the generation and the layout fingerprints, followed
+/// by the raw cluster array. It is not meant to be called during a search.
+
+bool TranspositionTable::save(const std::string& fileName) const {
+
+  char header[HeaderSize];
+  FileHeader h;
+
+  std::memcpy(h.magic, Magic, sizeof(Magic));
+  h.clusterSize  = ClusterSize;
+  h.clusterBytes = sizeof(Cluster);
+  h.clusterCount = clusterCount;
+  h.zobrist      = zobrist_fingerprint();
+  h.generation8  = generation8;
+  h.epoch16      = epoch16;
+
+  std::memset(header, 0, HeaderSize);
+  std::memcpy(header, &h, sizeof(h));
+
+  std::ofstream file(fileName.c_str(), std::ios::binary | std::ios::trunc);
+  file.write(header, HeaderSize);
+  file.write((const char*)table, std::streamsize(clusterCount * sizeof(Cluster)));
+  file.close();
+
+  if (!file)
+  {
+      sync_cout << "info string Failed to save hash to " << fileName << sync_endl;
+      return false;
+  }
+
+  sync_cout << "info string Hash " << (clusterCount * sizeof(Cluster) >> 20)
+            << " MB saved to " << fileName << sync_endl;
+  return true;
+}
+
+
+/// TranspositionTable::load() replaces the table with one written by save().
+/// On Linux the file is mapped privately, so loading a big table is almost
+/// instant and pages are read in as the search touches them; elsewhere it is
+/// read into newly allocated memory. Files written with a different entry
+/// layout or different Zobrist keys are refused and the table is left as is.
+
+bool TranspositionTable::load(const std::string& fileName) {
+
+  std::ifstream file(fileName.c_str(), std::ios::binary);
+  char header[HeaderSize];
+  FileHeader h;
+  const char* error = NULL;
+
+  if (!file.read(header, HeaderSize))
+      error = "cannot read header";
+  else
+  {
+      std::memcpy(&h, header, sizeof(h));
+      file.seekg(0, std::ios::end);
+      uint64_t fileSize = uint64_t(file.tellg());
+
+      if (std::memcmp(h.magic, Magic, sizeof(Magic)))
+          error = "not a hash file";
+
+      else if (   h.clusterSize  != uint32_t(ClusterSize)
+               || h.clusterBytes != uint32_t(sizeof(Cluster)))
+          error = "entry layout mismatch";
+
+      else if (h.zobrist != zobrist_fingerprint())
+          error = "Zobrist keys mismatch";
+
+      else if (   !h.clusterCount
+               || (h.clusterCount & (h.clusterCount - 1))
+               || h.clusterCount > uint64_t(size_t(-1)) / sizeof(Cluster)
+               || fileSize != HeaderSize + h.clusterCount * sizeof(Cluster))
+          error = "bad table size";
+  }
+
+  if (error)
+  {
+      sync_cout << "info string Hash not loaded from " << fileName
+                << ": " << error << sync_endl;
+      return false;
+  }
+
+  size_t tableSize = size_t(h.clusterCount) * sizeof(Cluster);
+
+#if defined(__linux__) && !defined(EMSCRIPTEN)
+  file.close();
+
+  // Writes to a private mapping never reach the file, which is only changed
+  // by an explicit save().
+  int fd = open(fileName.c_str(), O_RDONLY);
+  void* mapping = fd < 0 ? MAP_FAILED : mmap(NULL, HeaderSize + tableSize,
+                                             PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (fd >= 0)
+      close(fd);
+
+  if (mapping == MAP_FAILED)
+  {
+      sync_cout << "info string Hash not loaded from " << fileName
+                << ": cannot map file" << sync_endl;
+      return false;
+  }
+
+  madvise(mapping, HeaderSize + tableSize, MADV_WILLNEED); // Start read-ahead
+
+  free_table();
+  mem = mapping;
+  memSize = HeaderSize + tableSize;
+  mapped = true;
+  table = (Cluster*)((char*)mem + HeaderSize);
+  pages = "4 kB pages (file mapping)";
+#else
+  std::string newPages;
+  void* newMem = large_pages_alloc(tableSize, newPages);
+
+  file.seekg(HeaderSize, std::ios::beg);
+
+  if (!newMem || !file.read((char*)newMem, std::streamsize(tableSize)))
+  {
+      large_pages_free(newMem, tableSize);
+      sync_cout << "info string Hash not loaded from " << fileName
+                << ": cannot read table" << sync_endl;
+      return false;
+  }
+
+  free_table();
+  mem = newMem;
+  memSize = tableSize;
+  table = (Cluster*)mem;
+  pages = newPages;
+#endif
 
-void TranspositionTable::clear() {
+  clusterCount = size_t(h.clusterCount);
+  generation8 = h.generation8;
+  epoch16 = h.epoch16;
+  stats_init();
 
-  std::memset(table, 0, clusterCount * sizeof(Cluster));
+  sync_cout << "info string Hash " << (tableSize >> 20)
+            << " MB loaded from " << fileName << sync_endl;
+  return true;
 }
 
 
 /// TranspositionTable::probe() looks up the current position in the transposition
-/// table. It returns true and a pointer to the TTEntry if the position is found.
-/// Otherwise, it returns false and a pointer to an empty or least valuable TTEntry
+/// table. It returns true and a copy of the TTEntry if the position is found.
+/// Otherwise, it returns false and a copy of an empty or least valuable TTEntry
 /// to be replaced later. A TTEntry t1 is considered to be more valuable than a
 /// TTEntry t2 if t1 is from the current search and t2 is from a previous search,
-/// or if the depth of t1 is bigger than the depth of t2.
+/// or if the depth of t1 is bigger than the depth of t2. Torn entries fail the
+/// key check, so they are seen as belonging to other positions.
 
-TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
+TTEntry TranspositionTable::probe(const Key key, bool& found) const {
 
-  TTEntry* const tte = first_entry(key);
+  Cluster* const c = &table[(size_t)key & (clusterCount - 1)];
   const uint16_t key16 = key >> 48;  // Use the high 16 bits as key inside the cluster
+  TTEntry tte[ClusterSize];
+
+  if (c->epoch16 != epoch16) // Logically cleared, empty it now
+  {
+      for (int i = 0; i < ClusterSize; ++i)
+          c->key16[i] = 0, c->data[i] = 0;
+
+      c->epoch16 = epoch16;
+  }
+
+#ifdef TT_STATS
+  ++counters.probes;
+#endif
 
   for (int i = 0; i < ClusterSize; ++i)
+  {
+      tte[i].load(&c->key16[i], &c->data[i]);
+
+#ifdef TT_STATS
+      tte[i].fullKey = &counters.keys[(c - table) * ClusterSize + i];
+#endif
+
       if (!tte[i].key16 || tte[i].key16 == key16)
       {
           if (tte[i].key16)
+          {
               tte[i].genBound8 = uint8_t(generation8 | tte[i].bound()); // Refresh
+              tte[i].store();
+
+#ifdef TT_STATS
+              ++counters.hits;
 
-          return found = (bool)tte[i].key16, &tte[i];
+              // The full key is unknown for entries moved by a resize or loaded
+              if (*tte[i].fullKey && *tte[i].fullKey != key)
+                  ++counters.collisions;
+#endif
+          }
+
+          return found = (bool)tte[i].key16, tte[i];
       }
+  }
 
   // Find an entry to be replaced according to the replacement strategy
   TTEntry* replace = tte;
@@ -94,5 +552,252 @@ TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
           - (tte[i].depth8 < replace->depth8) < 0)
           replace = &tte[i];
 
-  return found = false, replace;
+#ifdef TT_STATS
+  ++counters.replaced[(replace->genBound8 & 0xFC) == generation8]
+                  [std::min(std::max(replace->depth8 + 3, 0) / 4, 5)];
+#endif
+
+  return found = false, *replace;
+}
+
+
+/// TranspositionTable::hashfull() returns an approximation of the table
+/// occupation during a search, in permill. The entries of the current search
+/// are counted in the first 1000 clusters (the table has at least 32768).
+
+int TranspositionTable::hashfull() const {
+
+  int cnt = 0;
+
+  for (int i = 0; i < 1000; ++i)
+      for (int j = 0; j < ClusterSize && table[i].epoch16 == epoch16; ++j)
+      {
+          TTEntry tte;
+          tte.load(&table[i].key16[j], &table[i].data[j]);
+          cnt += tte.key16 && (tte.genBound8 & 0xFC) == generation8;
+      }
+
+  return cnt / ClusterSize;
+}
+
+
+/// TranspositionTable::stats() returns a report, for the 'hashstats' command,
+/// of the occupation of the whole table and, when compiled with TT_STATS, of
+/// the counters since the table was last cleared or resized.
+
+std::string TranspositionTable::stats() const {
+
+  uint64_t used = 0, current = 0;
+
+  for (size_t i = 0; i < clusterCount; ++i)
+      for (int j = 0; j < ClusterSize && table[i].epoch16 == epoch16; ++j)
+      {
+          TTEntry tte;
+          tte.load(&table[i].key16[j], &table[i].data[j]);
+          used += tte.key16 != 0;
+          current += tte.key16 && (tte.genBound8 & 0xFC) == generation8;
+      }
+
+  uint64_t entries = uint64_t(clusterCount) * ClusterSize;
+  std::stringstream ss;
+
+  ss << "Hash size (MB)   : " << (clusterCount * sizeof(Cluster) >> 20)
+     << "\nEntries          : " << entries
+     << "\nUsed             : " << used << " (" << used * 1000 / entries << " permill)"
+     << "\nCurrent search   : " << current << " (" << current * 1000 / entries << " permill)"
+     << "\nHashfull         : " << hashfull();
+
+#ifdef TT_STATS
+  const char* ranges[] = { "< 1", "1-4", "5-8", "9-12", "13-16", "> 16" };
+  uint64_t probes = std::max(counters.probes, uint64_t(1));
+
+  ss << "\nProbes           : " << counters.probes
+     << "\nHits             : " << counters.hits << " (" << counters.hits * 1000 / probes << " permill)"
+     << "\nKey collisions   : " << counters.collisions
+     << "\nReplaced entries : depth  current search  older searches";
+
+  for (int d = 0; d < 6; ++d)
+      ss << "\n                   " << std::setw(5) << ranges[d]
+         << std::setw(16) << counters.replaced[1][d]
+         << std::setw(16) << counters.replaced[0][d];
+#else
+  ss << "\nCounters         : not compiled in, build with ttstats=yes";
+#endif
+
+  return ss.str();
+}
+
+
+/// StressJob is handed to each thread of a stress() run. The threads share a
+/// few clusters of a small table and only store entries whose data is derived
+/// from the key, so every entry read back can be checked.
+
+struct TranspositionTable::StressJob {
+  TranspositionTable* tt;
+  const Key* keys;
+  uint64_t probes, seed;
+  uint64_t hits, rejected, accepted;
+};
+
+namespace {
+
+  const int StressKeys = 64;
+  const int StressClusters = 4;
+
+  // The move, value, eval, depth and bound of an entry are bits 16-47 of its key
+  bool stress_entry_ok(Key k, const TTEntry& tte) {
+
+    return   tte.move()  == Move(uint16_t(k >> 16))
+          && tte.depth() == Depth((k >> 24) & 0x3F)
+          && tte.bound() == Bound((k >> 30) & 0x3)
+          && tte.value() == Value(int8_t(k >> 32))
+          && tte.eval()  == Value(int8_t(k >> 40));
+  }
+
+} // namespace
+
+
+/// TranspositionTable::stress() is a test of the lock-free entries, for the
+/// 'hashstress' command. The given number of threads probe and overwrite the
+/// same 4 clusters of a private table, and check all the entries of a cluster
+/// before each probe. An entry whose key is none of the stored ones is a torn
+/// entry that probe() rejects; an entry with a stored key and the data of
+/// another one is a torn entry that probe() would accept, and should never be
+/// seen.
+
+std::string TranspositionTable::stress(size_t threads, uint64_t probes) {
+
+#ifdef NO_THREADS
+  threads = 1; // Helper threads never run in single threaded Stockfish.js
+#endif
+
+  threads = std::max(threads, size_t(1));
+
+  TranspositionTable tt;
+  tt.resize(1);
+
+  // Keys of the first clusters, with distinct non-zero 16 bit keys
+  Key keys[StressKeys];
+  PRNG rng(1070372);
+
+  for (int i = 0; i < StressKeys; ++i)
+  {
+      keys[i] = (rng.rand<Key>() & ~Key(0xFFFF)) | Key(i % StressClusters);
+
+      for (int j = 0; j < i; ++j)
+          if (!(keys[i] >> 48) || (keys[i] >> 48) == (keys[j] >> 48))
+          {
+              --i;
+              break;
+          }
+  }
+
+  std::vector<StressJob> jobs(threads);
+  std::vector<NativeHandle> handles(threads - 1);
+
+  for (size_t i = 0; i < threads; ++i)
+  {
+      jobs[i].tt = &tt;
+      jobs[i].keys = keys;
+      jobs[i].probes = probes / threads;
+      jobs[i].seed = 7 + i;
+      jobs[i].hits = jobs[i].rejected = jobs[i].accepted = 0;
+  }
+
+  Time::point elapsed = Time::now();
+
+  for (size_t i = 0; i < handles.size(); ++i)
+      thread_create(handles[i], stress_worker, &jobs[i + 1]);
+
+  stress_worker(&jobs[0]);
+
+  for (size_t i = 0; i < handles.size(); ++i)
+      thread_join(handles[i]);
+
+  elapsed = Time::now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+  uint64_t total = 0, hits = 0, rejected = 0, accepted = 0;
+
+  for (size_t i = 0; i < threads; ++i)
+  {
+      total    += jobs[i].probes;
+      hits     += jobs[i].hits;
+      rejected += jobs[i].rejected;
+      accepted += jobs[i].accepted;
+  }
+
+  std::stringstream ss;
+
+  ss << "Threads          : " << threads
+     << "\nProbes           : " << total
+     << "\nHits             : " << hits
+     << "\nTorn, rejected   : " << rejected
+     << "\nTorn, accepted   : " << accepted
+     << "\nProbes/second    : " << 1000 * total / elapsed;
+
+  return ss.str();
+}
+
+
+/// TranspositionTable::stress_worker() is launched for each thread of a
+/// stress() run.
+
+void* TranspositionTable::stress_worker(void* arg) {
+
+  StressJob* job = static_cast<StressJob*>(arg);
+  TranspositionTable& tt = *job->tt;
+  PRNG rng(job->seed);
+
+  for (uint64_t n = 0; n < job->probes; ++n)
+  {
+      Key key = job->keys[rng.rand<unsigned>() % StressKeys];
+      Cluster* c = &tt.table[(size_t)key & (tt.clusterCount - 1)];
+
+      for (int i = 0; i < ClusterSize; ++i)
+      {
+          TTEntry tte;
+          tte.load(&c->key16[i], &c->data[i]);
+
+          if (!tte.key16)
+              continue;
+
+          int k = 0;
+          while (k < StressKeys && uint16_t(job->keys[k] >> 48) != tte.key16)
+              ++k;
+
+          if (k == StressKeys)
+              ++job->rejected;
+
+          else if (!stress_entry_ok(job->keys[k], tte))
+              ++job->accepted;
+      }
+
+      bool found;
+      TTEntry tte = tt.probe(key, found);
+      job->hits += found;
+
+      tte.save(key, Value(int8_t(key >> 32)), Bound((key >> 30) & 0x3),
+               Depth((key >> 24) & 0x3F), Move(uint16_t(key >> 16)),
+               Value(int8_t(key >> 40)), tt.generation8);
+  }
+
+  return NULL;
+}
+
+
+/// TranspositionTable::stats_init() sets up the counters of a new table
+
+void TranspositionTable::stats_init() {
+
+#ifdef TT_STATS
+  std::free(counters.keys);
+  counters.keys = (Key*)std::calloc(clusterCount * ClusterSize, sizeof(Key));
+  counters.reset();
+
+  if (!counters.keys)
+  {
+      std::cerr << "Failed to allocate the transposition table statistics." << std::endl;
+      exit(EXIT_FAILURE);
+  }
+#endif
 }
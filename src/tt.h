@@ -20,18 +20,27 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <cstdlib>
+#include <cstring>
+
 #include "misc.h"
 #include "types.h"
 
-/// TTEntry struct is the 10 bytes transposition table entry, defined as below:
+/// TTEntry struct is a copy of a transposition table entry, taken by probe()
+/// together with the address of its slot, so that save() can write it back.
+/// The entry data fits in 64 bits, defined as below:
 ///
-/// key        16 bit
 /// move       16 bit
 /// value      16 bit
 /// eval value 16 bit
 /// generation  6 bit
 /// bound type  2 bit
 /// depth       8 bit
+///
+/// In the table the data is stored as a single word and the 16 bit key is
+/// stored XOR-ed with a 16 bit fold of the data. A reader racing with a writer
+/// (or reading a word split by a 32 bit CPU) gets a key that doesn't match, so
+/// torn entries are rejected without any locking.
 
 struct TTEntry {
 
@@ -51,17 +60,55 @@ struct TTEntry {
     eval16    = (int16_t)ev;
     genBound8 = (uint8_t)(g | b);
     depth8    = (int8_t)d;
+    store();
+
+#ifdef TT_STATS
+    *fullKey = k;
+#endif
   }
 
 private:
   friend class TranspositionTable;
 
+  static uint16_t fold(uint64_t data) {
+    return uint16_t(data ^ (data >> 16) ^ (data >> 32) ^ (data >> 48));
+  }
+
+  void load(volatile uint16_t* k, volatile uint64_t* d) {
+
+    const uint64_t data = *d; // Read each word only once
+    keySlot   = k;
+    dataSlot  = d;
+    key16     = uint16_t(*k ^ fold(data));
+    move16    = uint16_t(data);
+    value16   = int16_t(data >> 16);
+    eval16    = int16_t(data >> 32);
+    genBound8 = uint8_t(data >> 48);
+    depth8    = int8_t(data >> 56);
+  }
+
+  void store() const {
+
+    const uint64_t data =  uint64_t(move16)
+                        | (uint64_t(uint16_t(value16)) << 16)
+                        | (uint64_t(uint16_t(eval16))  << 32)
+                        | (uint64_t(genBound8)         << 48)
+                        | (uint64_t(uint8_t(depth8))   << 56);
+    *dataSlot = data;
+    *keySlot  = uint16_t(key16 ^ fold(data));
+  }
+
   uint16_t key16;
   uint16_t move16;
   int16_t  value16;
   int16_t  eval16;
   uint8_t  genBound8;
   int8_t   depth8;
+  volatile uint16_t* keySlot;
+  volatile uint64_t* dataSlot;
+#ifdef TT_STATS
+  Key* fullKey;
+#endif
 };
 
 
@@ -77,30 +124,69 @@ class TranspositionTable {
   static const int ClusterSize = 3;
 
   struct Cluster {
-    TTEntry entry[ClusterSize];
-    char padding[2]; // Align to the cache line size
+    volatile uint16_t key16[ClusterSize];
+    volatile uint16_t epoch16; // Entries of a cluster from an older epoch are empty
+    volatile uint64_t data[ClusterSize];
   };
 
 public:
- ~TranspositionTable() { free(mem); }
+  TranspositionTable() : clusterCount(0), table(NULL), mem(NULL), memSize(0), mapped(false), generation8(0), epoch16(0) {}
+ ~TranspositionTable() { free_table(); }
   void new_search() { generation8 += 4; } // Lower 2 bits are used by Bound
   uint8_t generation() const { return generation8; }
-  TTEntry* probe(const Key key, bool& found) const;
-  void resize(size_t mbSize);
-  void clear();
+  TTEntry probe(const Key key, bool& found) const;
+  void resize(size_t mbSize, bool verbose = false);
+  void clear(bool logical = false);
+  int hashfull() const;
+  std::string info() const;
+  std::string stats() const;
+  bool save(const std::string& fileName) const;
+  bool load(const std::string& fileName);
+  static std::string stress(size_t threads, uint64_t probes);
 
   // The lowest order bits of the key are used to get the index of the cluster
-  TTEntry* first_entry(const Key key) const {
-    return &table[(size_t)key & (clusterCount - 1)].entry[0];
+  void* first_entry(const Key key) const {
+    return &table[(size_t)key & (clusterCount - 1)];
   }
 
 private:
+  struct Job;
+  struct StressJob;
+
+  static void* worker(void* job);
+  static void* stress_worker(void* job);
+  void run(Job& job) const;
+  void rehash(Cluster* newTable, size_t newClusterCount, size_t begin, size_t end) const;
+  void free_table();
+  void stats_init();
+
   size_t clusterCount;
   Cluster* table;
   void* mem;
+  size_t memSize;
+  bool mapped; // mem is a private mapping of a file written by save()
+  std::string pages; // How the memory is backed, see large_pages_alloc()
   uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
-};
+  uint16_t epoch16;
+
+#ifdef TT_STATS
+  // Counters of the opt-in statistics mode (make ttstats=yes). They are not
+  // atomic, so with several threads a few increments may be lost.
+  struct Stats {
+    Stats() : keys(NULL) { reset(); }
+   ~Stats() { std::free(keys); }
+    void reset() {
+      probes = hits = collisions = 0;
+      std::memset(replaced, 0, sizeof(replaced));
+    }
+
+    Key* keys; // Full key of each slot, to tell 16 bit key collisions from hits
+    uint64_t probes, hits, collisions;
+    uint64_t replaced[2][6]; // [same generation][depth range] of the replaced entry
+  };
 
-extern TranspositionTable TT;
+  mutable Stats counters;
+#endif
+};
 
 #endif // #ifndef TT_H_INCLUDED
@@ -63,8 +63,11 @@
 #  include <xmmintrin.h> // Intel and Microsoft header for _mm_prefetch()
 #endif
 
+#if defined(USE_PEXT) || defined(USE_AVX2)
+#  include <immintrin.h> // Header for _pext_u64() and AVX2 intrinsics
+#endif
+
 #if defined(USE_PEXT)
-#  include <immintrin.h> // Header for _pext_u64() intrinsic
 #  define pext(b, m) _pext_u64(b, m)
 #else
 #  define pext(b, m) (0)
@@ -90,6 +93,12 @@ const bool HasPext = true;
 const bool HasPext = false;
 #endif
 
+#ifdef USE_AVX2
+const bool HasAvx2 = true;
+#else
+const bool HasAvx2 = false;
+#endif
+
 #ifdef IS_64BIT
 const bool Is64Bit = true;
 #else
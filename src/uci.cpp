@@ -21,6 +21,7 @@
 #include <sstream>
 #include <string>
 
+#include "engine.h"
 #include "evaluate.h"
 #include "movegen.h"
 #include "position.h"
@@ -32,6 +33,8 @@
 using namespace std;
 
 extern void benchmark(const Position& pos, istream& is);
+extern void batch(istream& is);
+extern void evalcheck(istream& is);
 
 namespace {
 
@@ -67,7 +70,7 @@ namespace {
     else
         return;
 
-    pos.set(fen, Options["UCI_Chess960"], Threads.main());
+    pos.set(fen, Options["UCI_Chess960"], UCIEngine.threads.main());
     SetupStates = Search::StateStackPtr(new std::stack<StateInfo>());
 
     // Parse move list (if any)
@@ -96,6 +99,8 @@ namespace {
     while (is >> token)
         value += string(" ", !value.empty()) + token;
 
+    UCIEngine.threads.wait_for_think_finished(); // Options like Hash or Threads are used by the search
+
     if (Options.count(name))
         Options[name] = value;
     else
@@ -129,7 +134,7 @@ namespace {
         else if (token == "infinite")  limits.infinite = true;
         else if (token == "ponder")    limits.ponder = true;
 
-    Threads.start_thinking(pos, limits, SetupStates);
+    UCIEngine.threads.start_thinking(pos, limits, SetupStates);
   }
 
 } // namespace
@@ -144,7 +149,7 @@ namespace {
 ///NOTE: This has been modified for Stockfish.js since we can't have an infinite loop.
 Position pos;
   void UCI::commandInit() {
-    pos = Position(StartFEN, false, Threads.main()); // The root position
+    pos = Position(StartFEN, false, UCIEngine.threads.main()); // The root position
   }
   void UCI::command(const string& cmd) {
       string token;
@@ -160,21 +165,26 @@ Position pos;
       // switching from pondering to normal search.
       if (    token == "quit"
           ||  token == "stop"
-          || (token == "ponderhit" && Search::Signals.stopOnPonderhit))
+          || (token == "ponderhit" && UCIEngine.signals.stopOnPonderhit))
       {
-          Search::Signals.stop = true;
-          Threads.main()->notify_one(); // Could be sleeping
+          UCIEngine.signals.stop = true;
+          UCIEngine.threads.main()->notify_one(); // Could be sleeping
       }
       else if (token == "ponderhit")
-          Search::Limits.ponder = false; // Switch to normal search
+          UCIEngine.limits.ponder = false; // Switch to normal search
 
       else if (token == "uci")
           sync_cout << "id name " << engine_info(true)
                     << "\n"       << Options
-                    << "\nuciok"  << sync_endl;
+                    << "\nuciok"
+                    << "\ninfo string " << UCIEngine.tt->info() << sync_endl; // Startup allocation
 
       else if (token == "isready")    sync_cout << "readyok" << sync_endl;
-      else if (token == "ucinewgame") TT.clear();
+      else if (token == "ucinewgame")
+      {
+          UCIEngine.threads.wait_for_think_finished();
+          UCIEngine.tt->clear(Options["Fast Hash Clear"]);
+      }
       else if (token == "go")         go(pos, is);
       else if (token == "position")   position(pos, is);
       else if (token == "setoption")  setoption(is);
@@ -182,18 +192,68 @@ Position pos;
       // Additional custom non-UCI commands, useful for debugging
       else if (token == "flip")       pos.flip();
       else if (token == "bench")      benchmark(pos, is);
+      else if (token == "batch")      batch(is);
+      else if (token == "evalcheck")  evalcheck(is);
       else if (token == "d")          sync_cout << pos << sync_endl;
       else if (token == "eval")       sync_cout << Eval::trace(pos) << sync_endl;
-      else if (token == "perft")
+      else if (token == "hashstats")
+      {
+          uint64_t probes[2] = {}, hits[2] = {}, evals = 0, lazy = 0;
+          const char* names[] = { "Pawn hash hits   : ", "Material hits    : " };
+
+          for (size_t i = 0; i < UCIEngine.threads.size(); ++i)
+          {
+              Thread* th = UCIEngine.threads[i];
+              probes[0] += th->pawnProbes,     hits[0] += th->pawnHits;
+              probes[1] += th->materialProbes, hits[1] += th->materialHits;
+              evals += th->evals, lazy += th->lazyEvals;
+          }
+
+          sync_cout << UCIEngine.tt->stats();
+
+          for (int i = 0; i < 2; ++i)
+              cout << "\n" << names[i] << hits[i] << " of " << probes[i]
+                   << " (" << hits[i] * 1000 / max(probes[i], uint64_t(1)) << " permill)";
+
+          cout << "\nLazy evals       : " << lazy << " of " << evals
+               << " (" << lazy * 1000 / max(evals, uint64_t(1)) << " permill)";
+
+          cout << "\nPawn hash        : " << (UCIEngine.pawnsTable.enabled() ? "shared" : "per thread")
+               << sync_endl;
+      }
+      else if (token == "hashsave" || token == "hashload")
       {
-          int depth;
-          stringstream ss;
+          std::string fileName;
+          std::getline(is >> std::ws, fileName); // The file name may contain spaces
+
+          UCIEngine.threads.wait_for_think_finished();
 
+          if (token == "hashsave")
+              UCIEngine.tt->save(fileName);
+          else
+              UCIEngine.tt->load(fileName);
+      }
+      else if (token == "hashstress")
+      {
+          size_t threads = 4;
+          uint64_t probes = 10000000;
+          is >> threads >> probes;
+
+          std::string report = TranspositionTable::stress(threads, probes);
+          sync_cout << report << sync_endl;
+      }
+      else if (token == "perft")
+      {
+          int depth = 0;
           is >> depth;
-          ss << Options["Hash"]    << " "
-             << Options["Threads"] << " " << depth << " current perft";
 
-          benchmark(pos, ss);
+          Time::point elapsed = Time::now();
+          uint64_t nodes = Search::perft(pos, depth * ONE_PLY);
+          elapsed = Time::now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+          sync_cout << "\nTotal time (ms) : " << elapsed
+                    << "\nNodes searched  : " << nodes
+                    << "\nNodes/second    : " << 1000 * nodes / elapsed << sync_endl;
       }
       else
           sync_cout << "Unknown command: " << cmd << sync_endl;
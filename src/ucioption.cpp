@@ -22,6 +22,7 @@
 #include <cstdlib>
 #include <sstream>
 
+#include "engine.h"
 #include "evaluate.h" /// Stockfish.js
 #include "misc.h"
 #include "thread.h"
@@ -35,11 +36,12 @@ UCI::OptionsMap Options; // Global object
 namespace UCI {
 
 /// 'On change' actions, triggered by an option's value change
-void on_clear_hash(const Option&) { TT.clear(); }
-void on_hash_size(const Option& o) { TT.resize(o); }
+void on_clear_hash(const Option&) { UCIEngine.tt->clear(Options["Fast Hash Clear"]); }
+void on_hash_size(const Option& o) { UCIEngine.tt->resize(o, true); }
+void on_pawn_hash(const Option& o) { UCIEngine.threads.wait_for_think_finished(); UCIEngine.resize_pawn_hash(o); }
 void on_logger(const Option& o) { start_logger(o); }
 void on_eval(const Option&) { Eval::init(); }
-void on_threads(const Option&) { Threads.read_uci_options(); }
+void on_threads(const Option&) { UCIEngine.threads.read_uci_options(); }
 
 /// Our case insensitive less() function as required by UCI protocol
 bool ci_less(char c1, char c2) { return tolower(c1) < tolower(c2); }
@@ -67,8 +69,12 @@ void init(OptionsMap& o) {
   o["King Safety"]           << Option(100, 0, 200, on_eval);
   o["Min Split Depth"]       << Option(0, 0, 12, on_threads);
   o["Threads"]               << Option(1, 1, MAX_THREADS, on_threads);
+  o["Lazy SMP"]              << Option(false, on_threads);
+  o["NUMA Binding"]          << Option(false, on_threads);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["Fast Hash Clear"]       << Option(false);
+  o["Pawn Hash"]             << Option(0, 0, MaxHashMB, on_pawn_hash);
   o["Ponder"]                << Option(true);
   o["MultiPV"]               << Option(1, 1, 500);
   o["Skill Level"]           << Option(20, 0, 20);
@@ -107,16 +113,16 @@ std::ostream& operator<<(std::ostream& os, const OptionsMap& om) {
 
 /// Option class constructors and conversion operators
 
-Option::Option(const char* v, OnChange f) : type("string"), min(0), max(0), on_change(f)
+Option::Option(const char* v, OnChange f) : type("string"), min(0), max(0), idx(0), on_change(f)
 { defaultValue = currentValue = v; }
 
-Option::Option(bool v, OnChange f) : type("check"), min(0), max(0), on_change(f)
+Option::Option(bool v, OnChange f) : type("check"), min(0), max(0), idx(0), on_change(f)
 { defaultValue = currentValue = (v ? "true" : "false"); }
 
-Option::Option(OnChange f) : type("button"), min(0), max(0), on_change(f)
+Option::Option(OnChange f) : type("button"), min(0), max(0), idx(0), on_change(f)
 {}
 
-Option::Option(int v, int minv, int maxv, OnChange f) : type("spin"), min(minv), max(maxv), on_change(f)
+Option::Option(int v, int minv, int maxv, OnChange f) : type("spin"), min(minv), max(maxv), idx(0), on_change(f)
 { std::ostringstream ss; ss << v; defaultValue = currentValue = ss.str(); }
 
 
@@ -0,0 +1,101 @@
+/// Measures how the pthreads build (./build.sh threads) scales with the Threads option.
+/// Usage: node threads_tester.js [depth] [engine]
+///NOTE: The engine defaults to src/stockfish-threads.js. A native binary (e.g., src/stockfish) can be given to compare.
+
+var spawn = require("child_process").spawn;
+var path = require("path");
+
+var depth = Number(process.argv[2]) || 12;
+var engine_path = process.argv[3] || path.join(__dirname, "src", "stockfish-threads.js");
+var thread_counts = [];
+var cores = require("os").cpus().length;
+var stderr = "";
+var stockfish;
+var i;
+
+function good(mixed)
+{
+    console.log("\u001B[32m" + mixed + "\u001B[0m");
+}
+
+function warn(mixed)
+{
+    console.warn("\u001B[33m" + mixed + "\u001B[0m");
+}
+
+function error(mixed)
+{
+    console.error("\u001B[31m" + mixed + "\u001B[0m");
+}
+
+
+function write(str)
+{
+    warn("STDIN: " + str);
+    stockfish.stdin.write(str + "\n");
+}
+
+/// 1, 2, 4, ... up to the number of cores.
+for (i = 1; i < cores; i *= 2) {
+    thread_counts.push(i);
+}
+thread_counts.push(cores);
+
+/// Without a second count there is no scaling report.
+if (cores === 1) {
+    thread_counts.push(2);
+}
+
+if (engine_path.slice(-3).toLowerCase() === ".js") {
+    stockfish = spawn(process.execPath, [engine_path]);
+} else {
+    stockfish = spawn(engine_path);
+}
+
+stockfish.on("error", function (err)
+{
+    throw err;
+});
+
+stockfish.stdout.on("data", function onstdout(data)
+{
+    process.stdout.write(data.toString());
+});
+
+///NOTE: The "bench" command sends the results in stderr.
+stockfish.stderr.on("data", function onstderr(data)
+{
+    stderr += data.toString();
+});
+
+stockfish.on("exit", function (code)
+{
+    var table = stderr.indexOf("Threads   Time (ms)");
+
+    if (code) {
+        error("Exited with code: " + code);
+        throw new Error("Exited with code: " + code);
+    }
+
+    if (table === -1) {
+        error(stderr);
+        throw new Error("No scaling report found");
+    }
+
+    good("**Scaling at depth " + depth + " on " + cores + " cores**");
+    console.log(stderr.slice(table).trim());
+    process.exit();
+});
+
+
+setTimeout(function ()
+{
+    write("bench 16 " + thread_counts.join(",") + " " + depth + " default depth");
+    write("quit");
+}, 1000);
+
+setTimeout(function ()
+{
+    error("Timeout");
+    throw new Error("Timedout");
+}, 1000 * 60 * 30).unref();